@@ -0,0 +1,240 @@
+//==================================================//
+//			  BOUNDED BUFFER						//
+//==================================================//
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <errno.h>
+#include "BoundedBuffer.h"
+
+// Internal, called with the lock held.
+static void Put(Bounded_Buffer*, void*);
+static void* Take(Bounded_Buffer*);
+
+int Buffer_Init(Bounded_Buffer* buffer, int size, int producers)
+{
+	pthread_condattr_t attr;
+
+	buffer->in = 0;
+	buffer->out = 0;
+	buffer->no_elems = 0;
+	buffer->size = (size < 1) ? 1 : size;
+	buffer->producers = (producers < 1) ? 1 : producers;
+	buffer->closed = 0;
+	buffer->waitingFull = 0;
+	buffer->waitingEmpty = 0;
+	buffer->pushTimeouts = 0;
+	buffer->popTimeouts = 0;
+	buffer->items = malloc(buffer->size * sizeof(void*));
+
+	// Deadlines are on the monotonic clock, a wall clock step cannot stretch
+	// or cut a wait short.
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_mutex_init(&buffer->lock, NULL);
+	pthread_cond_init(&buffer->notFull, &attr);
+	pthread_cond_init(&buffer->notEmpty, &attr);
+	pthread_condattr_destroy(&attr);
+
+	return (buffer->items == NULL) ? -1 : 0;
+}
+
+void Buffer_Destroy(Bounded_Buffer* buffer)
+{
+	pthread_mutex_destroy(&buffer->lock);
+	pthread_cond_destroy(&buffer->notFull);
+	pthread_cond_destroy(&buffer->notEmpty);
+	free(buffer->items);
+	buffer->items = NULL;
+}
+
+void Buffer_Close(Bounded_Buffer* buffer)
+{
+	pthread_mutex_lock(&buffer->lock);
+
+	// The last producer closes the buffer and wakes every waiter, consumers
+	// drain what is left and then see BUFFER_CLOSED.
+	if (--buffer->producers == 0)
+	{
+		buffer->closed = 1;
+		pthread_cond_broadcast(&buffer->notEmpty);
+		pthread_cond_broadcast(&buffer->notFull);
+	}
+
+	pthread_mutex_unlock(&buffer->lock);
+}
+
+static void Put(Bounded_Buffer* buffer, void* item)
+{
+	buffer->items[buffer->in] = item;
+	buffer->in = (buffer->in + 1) % buffer->size;
+	buffer->no_elems++;
+
+	if (buffer->waitingEmpty > 0)
+	{
+		pthread_cond_signal(&buffer->notEmpty);
+	}
+}
+
+static void* Take(Bounded_Buffer* buffer)
+{
+	void *item = buffer->items[buffer->out];
+
+	buffer->out = (buffer->out + 1) % buffer->size;
+	buffer->no_elems--;
+
+	if (buffer->waitingFull > 0)
+	{
+		pthread_cond_signal(&buffer->notFull);
+	}
+
+	return item;
+}
+
+int Buffer_Try_Push(Bounded_Buffer* buffer, void* item)
+{
+	int status = BUFFER_FULL;
+
+	pthread_mutex_lock(&buffer->lock);
+
+	if (buffer->closed)
+	{
+		status = BUFFER_CLOSED;
+	}
+
+	else if (buffer->no_elems < buffer->size)
+	{
+		Put(buffer, item);
+		status = BUFFER_OK;
+	}
+
+	pthread_mutex_unlock(&buffer->lock);
+
+	return status;
+}
+
+int Buffer_Try_Pop(Bounded_Buffer* buffer, void** item)
+{
+	int status = BUFFER_EMPTY;
+
+	pthread_mutex_lock(&buffer->lock);
+
+	if (buffer->no_elems > 0)
+	{
+		*item = Take(buffer);
+		status = BUFFER_OK;
+	}
+
+	else if (buffer->closed)
+	{
+		status = BUFFER_CLOSED;
+	}
+
+	pthread_mutex_unlock(&buffer->lock);
+
+	return status;
+}
+
+int Buffer_Push_Until(Bounded_Buffer* buffer, void* item, const struct timespec* deadline)
+{
+	int status = BUFFER_OK;
+
+	pthread_mutex_lock(&buffer->lock);
+
+	while (buffer->no_elems == buffer->size && !buffer->closed && status == BUFFER_OK)
+	{
+		buffer->waitingFull++;
+
+		if (deadline == NULL)
+		{
+			pthread_cond_wait(&buffer->notFull, &buffer->lock);
+		}
+
+		else if (pthread_cond_timedwait(&buffer->notFull, &buffer->lock, deadline) == ETIMEDOUT)
+		{
+			status = BUFFER_TIMEOUT;
+		}
+
+		buffer->waitingFull--;
+	}
+
+	// Nothing is pushed after the close, a slot that opened right at the
+	// deadline is still taken.
+	if (buffer->closed)
+	{
+		status = BUFFER_CLOSED;
+	}
+
+	else if (buffer->no_elems < buffer->size)
+	{
+		Put(buffer, item);
+		status = BUFFER_OK;
+	}
+
+	else
+	{
+		buffer->pushTimeouts++;
+	}
+
+	pthread_mutex_unlock(&buffer->lock);
+
+	return status;
+}
+
+int Buffer_Pop_Until(Bounded_Buffer* buffer, void** item, const struct timespec* deadline)
+{
+	int status = BUFFER_OK;
+
+	pthread_mutex_lock(&buffer->lock);
+
+	while (buffer->no_elems == 0 && !buffer->closed && status == BUFFER_OK)
+	{
+		buffer->waitingEmpty++;
+
+		if (deadline == NULL)
+		{
+			pthread_cond_wait(&buffer->notEmpty, &buffer->lock);
+		}
+
+		else if (pthread_cond_timedwait(&buffer->notEmpty, &buffer->lock, deadline) == ETIMEDOUT)
+		{
+			status = BUFFER_TIMEOUT;
+		}
+
+		buffer->waitingEmpty--;
+	}
+
+	// Items left after the close are still handed out.
+	if (buffer->no_elems > 0)
+	{
+		*item = Take(buffer);
+		status = BUFFER_OK;
+	}
+
+	else if (buffer->closed)
+	{
+		status = BUFFER_CLOSED;
+	}
+
+	else
+	{
+		buffer->popTimeouts++;
+	}
+
+	pthread_mutex_unlock(&buffer->lock);
+
+	return status;
+}
+
+void Buffer_Deadline(struct timespec* deadline, long microseconds)
+{
+	// Absolute deadline, now + microseconds on the monotonic clock.
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec += microseconds / 1000000;
+	deadline->tv_nsec += (microseconds % 1000000) * 1000;
+
+	if (deadline->tv_nsec >= 1000000000)
+	{
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
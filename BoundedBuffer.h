@@ -0,0 +1,54 @@
+//==================================================//
+//			  BOUNDED BUFFER						//
+//==================================================//
+#ifndef BOUNDED_BUFFER_H
+#define BOUNDED_BUFFER_H
+
+#include <time.h>
+#include <pthread.h>
+
+// Return values of the push and pop calls.
+#define BUFFER_OK 0
+#define BUFFER_FULL 1		// Try push, no free slot.
+#define BUFFER_EMPTY 2		// Try pop, no item.
+#define BUFFER_TIMEOUT 3	// Timed push or pop, the deadline passed.
+#define BUFFER_CLOSED 4		// Push after the close, or pop of a closed and drained buffer.
+
+// Ring of pointers guarded by one mutex. Blocked callers sleep on a
+// condition variable (CLOCK_MONOTONIC for the timed calls), they are only
+// signalled when someone actually waits.
+//
+// The buffer is closed once each of its producers has called Buffer_Close().
+// Consumers then drain the items left and get BUFFER_CLOSED, so a stream
+// needs no item count, and everyone asleep on the buffer is woken.
+//
+// A buffer backend provides Try_Push/Try_Pop (never block), Push_Until/
+// Pop_Until (block until the absolute deadline, NULL = no deadline), Close
+// and the timeout counters, so callers do not depend on how the ring is built.
+typedef struct
+{
+	int in, out;
+	int no_elems;
+	int size;
+	void **items;
+	int producers;			// Producers that have not closed yet.
+	int closed;
+	int waitingFull;		// Pushers asleep on notFull.
+	int waitingEmpty;		// Poppers asleep on notEmpty.
+	long pushTimeouts;
+	long popTimeouts;
+	pthread_mutex_t lock;
+	pthread_cond_t notFull;
+	pthread_cond_t notEmpty;
+} Bounded_Buffer;
+
+int Buffer_Init(Bounded_Buffer*, int, int);
+void Buffer_Destroy(Bounded_Buffer*);
+void Buffer_Close(Bounded_Buffer*);
+int Buffer_Try_Push(Bounded_Buffer*, void*);
+int Buffer_Try_Pop(Bounded_Buffer*, void**);
+int Buffer_Push_Until(Bounded_Buffer*, void*, const struct timespec*);
+int Buffer_Pop_Until(Bounded_Buffer*, void**, const struct timespec*);
+void Buffer_Deadline(struct timespec*, long);
+
+#endif
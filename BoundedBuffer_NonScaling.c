@@ -2,8 +2,11 @@
 //			  NON-SCALING BOUNDED BUFFER			//
 //==================================================//
 #include <stdio.h>
+#include <stdlib.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include "PayloadPool.h"
+#include "BoundedBuffer.h"
 
 #define BUFFER_SIZE 10
 #define NO_PRODUCERS 16
@@ -11,77 +14,95 @@
 #define KILO 1024
 #define MEGA (KILO*KILO)
 #define ITEMS_TO_SEND 10000000 // number of items to pass through the buffer.
+#define PUSH_TIMEOUT 0 // microseconds a producer waits on a full buffer before it drops the item, 0 = no limit.
+#define POP_TIMEOUT 0 // microseconds a consumer sleeps on an empty buffer before it checks again, 0 = no limit.
 
 // Structs.
-typedef struct buffer_t
+// Payload of an item, allocated from the producer's pool and freed by the
+// consumer that takes it.
+typedef struct record_t
 {
-    int in, out;
-    int no_elems;
-    int buf[BUFFER_SIZE];
-    pthread_mutex_t lock;
-};
-
-// Variables.
-static int no_items_sent = 0;
-static int no_items_recieved = 0;
+    int item;
+    long producer;
+} record_t;
+
+// Variables, each thread writes its own counts once it is done.
+static int no_items_sent[NO_PRODUCERS];
+static int no_items_dropped[NO_PRODUCERS];
+static int no_items_recieved[NO_CONSUMERS];
 static int print_flag = 0;	// 1 = printouts, 0 = no printouts.
-static buffer_t buffer;
+static Bounded_Buffer buffer;
+static Payload_Pool pools[NO_PRODUCERS];	// one per producer.
 
 // Buffer initialization.
 void init_buffer(void)
 {
-    buffer.in = 0;
-    buffer.out = 0;
-    buffer.no_elems = 0;
-    pthread_mutex_init(&buffer.lock, NULL);
+    if (Buffer_Init(&buffer, BUFFER_SIZE, NO_PRODUCERS) != 0)
+	{
+		printf("Could not allocate the buffer.\n");
+		exit(1);
+	}
 }
 
 // Consumer code.
 void *consumer(void *thr_id)
 {
-	int item;
-	int c_quit = 0;
+	int item, status;
+	int recieved = 0;
 	long my_id = (long) thr_id;
+	record_t *record;
+	struct timespec deadline;
     
 	if (print_flag)
 	{
-		printf("Cstart 4: tid %d\n", my_id);
+		printf("Cstart 4: tid %ld\n", my_id);
 	}
 
-	while(!c_quit) 
+	// Take an item without waiting if there is one, otherwise sleep while
+	// the buffer is empty, stop once it is closed and drained.
+	while (1)
 	{
-		pthread_mutex_lock(&buffer.lock);
+		status = Buffer_Try_Pop(&buffer, (void**)&record);
 
-		if (no_items_recieved < ITEMS_TO_SEND) 
+		if (status == BUFFER_EMPTY && POP_TIMEOUT > 0)
 		{
-			// check if there is empty buffer places.
-			if (buffer.no_elems > 0) 
-			{
-				//delay_in_buffer();
-				item = buffer.buf[buffer.out];
-				buffer.out = (buffer.out + 1) % BUFFER_SIZE;
-				buffer.no_elems--;
-				no_items_recieved++;
-
-				if (print_flag)
-				{
-					printf("Consumer %d got number %d from buffer (%d items)\n", my_id, item, buffer.no_elems);
-				}
-			}
-		} 
-		
-		else 
+			Buffer_Deadline(&deadline, POP_TIMEOUT);
+			status = Buffer_Pop_Until(&buffer, (void**)&record, &deadline);
+		}
+
+		else if (status == BUFFER_EMPTY)
+		{
+			status = Buffer_Pop_Until(&buffer, (void**)&record, NULL);
+		}
+
+		// Still empty at the deadline, wait again.
+		if (status == BUFFER_TIMEOUT)
+		{
+			continue;
+		}
+
+		if (status != BUFFER_OK)
+		{
+			break;
+		}
+
+		recieved++;
+		item = record->item;
+
+		if (print_flag)
 		{
-			c_quit = 1;
+			printf("Consumer %ld got number %d from producer %ld\n", my_id, item, record->producer);
 		}
 
-		pthread_mutex_unlock(&buffer.lock);
-		//usleep(10);
+		// Return the payload to its producer.
+		Payload_Free(record);
 	}
 
+	no_items_recieved[my_id] = recieved;
+
 	if (print_flag)
 	{
-		printf("CBreak 4: tid %d\n", my_id);
+		printf("CBreak 4: tid %ld\n", my_id);
 	}
 
 	pthread_exit(0);
@@ -90,46 +111,68 @@ void *consumer(void *thr_id)
 // Producer code.
 void *producer(void *thr_id)
 {
-	int item;
-	int p_quit = 0;
+	int item, status, sent = 0, dropped = 0;
 	long my_id = (long) thr_id;
+	record_t *record;
+	struct timespec deadline;
+
+	// This producer's share of the items, no shared counter per item.
+	int first = (long)ITEMS_TO_SEND * my_id / NO_PRODUCERS;
+	int last = (long)ITEMS_TO_SEND * (my_id + 1) / NO_PRODUCERS;
 
 	if (print_flag)
 	{
-		printf("Pstart 4: tid %d\n", my_id);
+		printf("Pstart 4: tid %ld\n", my_id);
 	}
 
-	while(!p_quit) 
+	for (item = first; item < last; item++)
 	{
-		pthread_mutex_lock(&buffer.lock);
+		record = Payload_Alloc(&pools[my_id]);
+		record->item = item;
+		record->producer = my_id;
+
+		// Push without waiting if there is room, otherwise sleep while the
+		// buffer is full, up to the deadline if there is one.
+		status = Buffer_Try_Push(&buffer, record);
 
-		if (no_items_sent < ITEMS_TO_SEND) 
+		if (status == BUFFER_FULL && PUSH_TIMEOUT > 0)
 		{
-			// Check if there is empty buffer places.
-			if (buffer.no_elems < BUFFER_SIZE) 
-			{
-				//delay_in_buffer();
-				item = no_items_sent++;
-				buffer.buf[buffer.in] = item;
-				buffer.in = (buffer.in + 1) % BUFFER_SIZE;
-				buffer.no_elems++;
-				if (print_flag)
-				printf("Producer %d put number %d in buffer (%d items)\n", my_id, item, buffer.no_elems);
-			}
-		} 
-	
-		else 
+			Buffer_Deadline(&deadline, PUSH_TIMEOUT);
+			status = Buffer_Push_Until(&buffer, record, &deadline);
+		}
+
+		else if (status == BUFFER_FULL)
 		{
-			p_quit = 1;
+			status = Buffer_Push_Until(&buffer, record, NULL);
 		}
 
-		pthread_mutex_unlock(&buffer.lock);
-		//usleep(10);
+		if (status != BUFFER_OK)
+		{
+			// Full past the deadline, drop the item.
+			Payload_Free(record);
+			dropped++;
+		}
+
+		else
+		{
+			sent++;
+
+			if (print_flag)
+			{
+				printf("Producer %ld put number %d in buffer\n", my_id, item);
+			}
+		}
 	}
 
+	no_items_sent[my_id] = sent;
+	no_items_dropped[my_id] = dropped;
+
+	// The last producer to finish closes the buffer.
+	Buffer_Close(&buffer);
+
 	if (print_flag)
 	{
-		printf("PBreak 4: tid %d\n", my_id);
+		printf("PBreak 4: tid %ld\n", my_id);
 	}
 
 	pthread_exit(0);
@@ -146,6 +189,15 @@ int main(int argc, char **argv)
     init_buffer();
     pthread_attr_init (&attr);
 
+    for(i = 0; i < NO_PRODUCERS; i++)
+	{
+		if (Payload_Pool_Init(&pools[i], sizeof(record_t)) != 0)
+		{
+			printf("Could not set up the payload pools.\n");
+			exit(1);
+		}
+	}
+
     printf("Buffer size = %d, items to send = %d\n", BUFFER_SIZE, ITEMS_TO_SEND);
 
 	struct timeval start, end;
@@ -181,5 +233,29 @@ int main(int argc, char **argv)
 	unsigned long int diff = end_msec - start_msec;
 	double diff_in_sec = diff / 1000000.0;
 
-	printf("Time: %f", diff_in_sec);
+	printf("Time: %f\n", diff_in_sec);
+
+	long hits = 0, misses = 0;
+	size_t footprint = 0;
+	int sent = 0, recieved = 0, dropped = 0;
+
+	for (i = 0; i < NO_CONSUMERS; i++)
+	{
+		recieved += no_items_recieved[i];
+	}
+
+	for (i = 0; i < NO_PRODUCERS; i++)
+	{
+		sent += no_items_sent[i];
+		dropped += no_items_dropped[i];
+		hits += pools[i].hits;
+		misses += pools[i].misses;
+		footprint += pools[i].footprint;
+		Payload_Pool_Destroy(&pools[i]);
+	}
+
+	printf("Payload pools: %ld hits, %ld misses, %zu bytes peak footprint\n", hits, misses, footprint);
+	printf("Items: %d sent, %d recieved, %d dropped\n", sent, recieved, dropped);
+	printf("Push timeouts: %ld, pop timeouts: %ld\n", buffer.pushTimeouts, buffer.popTimeouts);
+	Buffer_Destroy(&buffer);
 }
\ No newline at end of file
@@ -3,8 +3,11 @@
 //==================================================//
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include "PayloadPool.h"
+#include "BoundedBuffer.h"
 
 // Debug print flag.
 #define DEBUG 1
@@ -23,21 +26,29 @@
 #define ITEMS_PER_LINE (ITEMS_TO_SEND / PRODUCTION_LINES)
 static int ITEMS_SENT[PRODUCTION_LINES];
 static int ITEMS_RECIEVED[PRODUCTION_LINES];
+static int ITEMS_DROPPED[PRODUCTION_LINES];
 
-// Buffer struct.
+// Microseconds a producer waits on a full buffer before it drops the item,
+// 0 = no limit.
+#define PUSH_TIMEOUT 0
+
+// Microseconds a consumer sleeps on an empty buffer before it wakes up to
+// check again, 0 = no limit.
+#define POP_TIMEOUT 0
+
+// Item payload, allocated from the line's pool by the producer and freed
+// by the consumer.
 typedef struct
 {
-	int m_input;
-	int m_output;
-	int m_numberOfItems;
-	int m_items[BUFFER_SIZE];
-
-	// Buffer mutex lock.
-	pthread_mutex_t m_lock;
-} Buffer;
+	int m_value;
+	long m_line;
+} Item;
 
 // Create enough buffers to have one per production line.
-static Buffer buffer[PRODUCTION_LINES];
+static Bounded_Buffer buffer[PRODUCTION_LINES];
+
+// Payload pool of each line's producer.
+static Payload_Pool pool[PRODUCTION_LINES];
 
 // ===== BUFFER INITIALIZATION =====
 void InitializeBuffers(void)
@@ -50,10 +61,11 @@ void InitializeBuffers(void)
 	int i;
 	for (i = 0; i < PRODUCTION_LINES; i++)
 	{
-		buffer[i].m_input = 0;
-		buffer[i].m_output = 0;
-		buffer[i].m_numberOfItems = 0;
-		pthread_mutex_init(&buffer[i].m_lock, NULL);
+		if (Buffer_Init(&buffer[i], BUFFER_SIZE, 1) != 0 || Payload_Pool_Init(&pool[i], sizeof(Item)) != 0)
+		{
+			printf("\nCould not set up the buffer and payload pool of line %d.\n", i);
+			exit(1);
+		}
 	}
 
 	if (DEBUG)
@@ -65,8 +77,12 @@ void InitializeBuffers(void)
 // ===== PRODUCER CODE =====
 void *Producer(void *p_threadID)
 {
-	int l_item = 0;
-	int l_quit = 0;
+	int l_status = 0;
+	int l_produced = 0;
+	int l_sent = 0;
+	int l_dropped = 0;
+	Item *l_payload = NULL;
+	struct timespec l_deadline;
 
 	// Individual thread ID.
 	long l_threadID = (long)p_threadID;
@@ -79,35 +95,48 @@ void *Producer(void *p_threadID)
 		printf("\nProducer thread %lu beginning work...", l_threadID);
 	}
 
-	// Producer work loop.
-	while (!l_quit)
+	// Producer work loop, only items that made it into the buffer count as sent.
+	while (l_produced < ITEMS_PER_LINE)
 	{
-		// Lock the buffer for safe item adding.
-		pthread_mutex_lock(&buffer[l_threadID].m_lock);
+		// Allocate the payload outside the buffer lock.
+		l_payload = Payload_Alloc(&pool[l_threadID]);
+		l_payload->m_line = l_threadID;
+		l_payload->m_value = (l_produced++) + l_itemOffset;
+
+		// Push without waiting if there is room, otherwise sleep while the
+		// buffer is full, up to the deadline if there is one.
+		l_status = Buffer_Try_Push(&buffer[l_threadID], l_payload);
 
-		// Check to see if more items are to be sent.
-		if (ITEMS_SENT[l_threadID] < ITEMS_PER_LINE)
+		if (l_status == BUFFER_FULL && PUSH_TIMEOUT > 0)
 		{
-			// Check to make sure the buffer is not currently filled.
-			if (buffer[l_threadID].m_numberOfItems < BUFFER_SIZE)
-			{
-				// Add new item and increment counters.
-				l_item = (ITEMS_SENT[l_threadID]++) + l_itemOffset;
-				buffer[l_threadID].m_items[buffer[l_threadID].m_input] = l_item;
-				buffer[l_threadID].m_input = (buffer[l_threadID].m_input + 1) % BUFFER_SIZE;
-				buffer[l_threadID].m_numberOfItems++;
-			}
+			Buffer_Deadline(&l_deadline, PUSH_TIMEOUT);
+			l_status = Buffer_Push_Until(&buffer[l_threadID], l_payload, &l_deadline);
 		}
 
-		else
+		else if (l_status == BUFFER_FULL)
 		{
-			l_quit = 1;
+			l_status = Buffer_Push_Until(&buffer[l_threadID], l_payload, NULL);
 		}
 
-		// Unlock the buffer.
-		pthread_mutex_unlock(&buffer[l_threadID].m_lock);
+		// Drop the item if it did not fit in time.
+		if (l_status != BUFFER_OK)
+		{
+			Payload_Free(l_payload);
+			l_dropped++;
+		}
+
+		else
+		{
+			l_sent++;
+		}
 	}
 
+	// End of the line's stream, its consumer drains the buffer and stops.
+	Buffer_Close(&buffer[l_threadID]);
+
+	ITEMS_SENT[l_threadID] = l_sent;
+	ITEMS_DROPPED[l_threadID] = l_dropped;
+
 	if (DEBUG)
 	{
 		printf("\nProducer thread %lu completed.", l_threadID);
@@ -121,7 +150,10 @@ void *Producer(void *p_threadID)
 void *Consumer(void *p_threadID)
 {
 	int l_item = 0;
-	int l_quit = 0;
+	int l_recieved = 0;
+	int l_status;
+	Item *l_payload = NULL;
+	struct timespec l_deadline;
 
 	// Individual thread ID.
 	long l_threadID = (long)p_threadID;
@@ -131,35 +163,45 @@ void *Consumer(void *p_threadID)
 		printf("\nConsumer thread %lu beginning work...", l_threadID);
 	}
 
-	// Consumer work loop.
-	while (!l_quit)
+	// Consumer work loop, take an item without waiting if there is one,
+	// otherwise sleep while the buffer is empty, and stop once the line is
+	// closed and drained.
+	while (1)
 	{
-		// Lock the buffer for safe item removal.
-		pthread_mutex_lock(&buffer[l_threadID].m_lock);
+		l_status = Buffer_Try_Pop(&buffer[l_threadID], (void **)&l_payload);
 
-		// Check to see if more items are to be recieved.
-		if (ITEMS_RECIEVED[l_threadID] < ITEMS_PER_LINE)
+		if (l_status == BUFFER_EMPTY && POP_TIMEOUT > 0)
 		{
-			// Check to make sure the buffer is not currently empty.
-			if (buffer[l_threadID].m_numberOfItems > 0)
-			{
-				// Consume items and increment counters.
-				l_item = buffer[l_threadID].m_items[buffer[l_threadID].m_output];
-				buffer[l_threadID].m_output = (buffer[l_threadID].m_output + 1) % BUFFER_SIZE;
-				buffer[l_threadID].m_numberOfItems--;
-				ITEMS_RECIEVED[l_threadID]++;
-			}
+			Buffer_Deadline(&l_deadline, POP_TIMEOUT);
+			l_status = Buffer_Pop_Until(&buffer[l_threadID], (void **)&l_payload, &l_deadline);
 		}
 
-		else
+		else if (l_status == BUFFER_EMPTY)
+		{
+			l_status = Buffer_Pop_Until(&buffer[l_threadID], (void **)&l_payload, NULL);
+		}
+
+		// Still empty at the deadline, a consumer with other work would do
+		// it here before it waits again.
+		if (l_status == BUFFER_TIMEOUT)
+		{
+			continue;
+		}
+
+		if (l_status != BUFFER_OK)
 		{
-			l_quit = 1;
+			break;
 		}
 
-		// Unlock the buffer.
-		pthread_mutex_unlock(&buffer[l_threadID].m_lock);
+		l_recieved++;
+
+		// Read the payload and return it to the producer's pool.
+		l_item = l_payload->m_value;
+		Payload_Free(l_payload);
 	}
 
+	ITEMS_RECIEVED[l_threadID] = l_recieved;
+
 	if (DEBUG)
 	{
 		printf("\nConsumer thread %lu completed.", l_threadID);
@@ -267,4 +309,34 @@ int main(int argc, char **argv)
 	unsigned long int l_difference = l_endMSec - l_startMSec;
 	double l_differenceInSeconds = l_difference / 1000000.0;
 	printf("\n(!) Time taken to send %d items: %f seconds.\n", ITEMS_TO_SEND, l_differenceInSeconds);
+
+	// Payload pool statistics.
+	long l_hits = 0;
+	long l_misses = 0;
+	size_t l_footprint = 0;
+
+	for (i = 0; i < PRODUCTION_LINES; i++)
+	{
+		l_hits += pool[i].hits;
+		l_misses += pool[i].misses;
+		l_footprint += pool[i].footprint;
+		Payload_Pool_Destroy(&pool[i]);
+	}
+
+	printf("(!) Payload pools: %ld hits, %ld misses, %zu bytes peak footprint.\n", l_hits, l_misses, l_footprint);
+
+	// Timeouts and drops of all lines.
+	int l_dropped = 0;
+	long l_pushTimeouts = 0;
+	long l_popTimeouts = 0;
+
+	for (i = 0; i < PRODUCTION_LINES; i++)
+	{
+		l_dropped += ITEMS_DROPPED[i];
+		l_pushTimeouts += buffer[i].pushTimeouts;
+		l_popTimeouts += buffer[i].popTimeouts;
+		Buffer_Destroy(&buffer[i]);
+	}
+
+	printf("(!) Dropped items: %d, push timeouts: %ld, pop timeouts: %ld.\n", l_dropped, l_pushTimeouts, l_popTimeouts);
 }
\ No newline at end of file
@@ -0,0 +1,472 @@
+//==================================================//
+//		    BATCHED GAUSSIAN ELIMINATION			//
+//==================================================//
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "GuassianSolver.h"
+
+// Systems per batch, one per vector lane. 8 doubles fill an AVX-512
+// register, two AVX2 or four SSE2 registers.
+#define LANES 8
+
+#define DEFAULT_SIZE 8
+#define MAX_SIZE 64
+
+// Memory for A when the number of systems is not given.
+#define DEFAULT_BYTES (256 * 1024 * 1024)
+
+// Verification passes if the backward error is below VERIFY_SCALE * n * eps.
+#define VERIFY_SCALE 10.0
+
+#define ALIGNMENT 64
+
+int	n;					// Size of each system.
+long systems;			// Number of systems.
+long batches;			// systems / LANES rounded up, the last one may be padded.
+int	maxnum;				// max number of element.
+unsigned long long seed;	// seed of the matrices.
+int THREADS;			// number of threads, 0 = online CPUs.
+int GENERIC;			// generic switch, 1 = skip the fixed size kernels.
+int VERIFY;				// verify switch.
+
+// Batch p holds systems p * LANES .. p * LANES + LANES - 1 interleaved,
+// element (i, j) of lane l at A[((p * n + i) * n + j) * LANES + l], and
+// b and x at [(p * n + i) * LANES + l].
+double *A;
+double *b;
+double *x;
+
+// Thread variables.
+pthread_t *thread;
+typedef struct
+{
+	int id;
+	long start;
+	long stop;
+} ThreadData;
+
+ThreadData *threadData;
+double *threadError;	// largest backward error found by each thread.
+
+typedef void (*Batch_Solver)(int, double*, double*, double*);
+Batch_Solver solver;
+
+void Solve_Generic(int, double*, double*, double*);
+void Solve_4(int, double*, double*, double*);
+void Solve_8(int, double*, double*, double*);
+void Solve_16(int, double*, double*, double*);
+void Solve_32(int, double*, double*, double*);
+void Solve_64(int, double*, double*, double*);
+void Fork_Join(void* (*)(void*));
+void* ThreadInitWork(void*);
+void* ThreadSolveWork(void*);
+void* ThreadVerifyWork(void*);
+double Element(long, int, int);
+double Now(void);
+void Read_Options(int, char **);
+
+void Init_Default()
+{
+	n = DEFAULT_SIZE;
+	systems = 0;
+	maxnum = 15;
+	seed = 1;
+	THREADS = 0;
+	GENERIC = 0;
+	VERIFY = 1;
+}
+
+int main(int argc, char **argv)
+{
+	double start_time, init_time, error = 0.0, threshold = 0.0;
+	int i;
+
+	// Init default values.
+	Init_Default();
+
+	// Read arguments.
+	Read_Options(argc, argv);
+
+	if (n < 1 || n > MAX_SIZE)
+	{
+		printf("System size must be 1..%d.\n", MAX_SIZE);
+		exit(1);
+	}
+
+	if (systems <= 0)
+	{
+		systems = DEFAULT_BYTES / ((long)n * n * sizeof(double));
+	}
+
+	batches = (systems + LANES - 1) / LANES;
+	THREADS = (THREADS <= 0) ? sysconf(_SC_NPROCESSORS_ONLN) : THREADS;
+
+	// Fixed size kernels, the loops are unrolled for their n.
+	switch (GENERIC ? 0 : n)
+	{
+		case 4: solver = Solve_4; break;
+		case 8: solver = Solve_8; break;
+		case 16: solver = Solve_16; break;
+		case 32: solver = Solve_32; break;
+		case 64: solver = Solve_64; break;
+		default: solver = Solve_Generic; break;
+	}
+
+	printf("Mode      = Batched\n");
+	printf("Size      = %dx%d \n", n, n);
+	printf("Systems   = %ld (%ld batches of %d, %ld padding) \n", systems, batches, LANES, batches * LANES - systems);
+	printf("Seed      = %llu \n", seed);
+	printf("Threads   = %d \n", THREADS);
+	printf("Kernel    = %s \n", (solver == Solve_Generic) ? "generic" : "fixed size");
+	printf("Initializing matrices...\n");
+
+	if (posix_memalign((void**)&A, ALIGNMENT, (size_t)batches * LANES * n * n * sizeof(double)) != 0 ||
+		posix_memalign((void**)&b, ALIGNMENT, (size_t)batches * LANES * n * sizeof(double)) != 0 ||
+		posix_memalign((void**)&x, ALIGNMENT, (size_t)batches * LANES * n * sizeof(double)) != 0)
+	{
+		printf("Could not allocate %ld systems.\n", systems);
+		exit(1);
+	}
+
+	thread = malloc(THREADS * sizeof(pthread_t));
+	threadData = malloc(THREADS * sizeof(ThreadData));
+	threadError = calloc(THREADS, sizeof(double));
+
+	// Each thread fills the batches it solves (first touch).
+	init_time = Now();
+	Fork_Join(ThreadInitWork);
+	printf("Done! (%f seconds)\n\n", Now() - init_time);
+
+	start_time = Now();
+	Fork_Join(ThreadSolveWork);
+	start_time = Now() - start_time;
+
+	printf("Execution time: %f\n", start_time);
+	printf("Systems/sec: %.0f\n", systems / start_time);
+	printf("GFLOP/s: %.2f\n", systems * (2.0 * n * (double)n * n / 3.0 + 2.0 * n * (double)n) / start_time / 1e9);
+
+	if (VERIFY == 1)
+	{
+		Fork_Join(ThreadVerifyWork);
+
+		for (i = 0; i < THREADS; i++)
+		{
+			// NaN propagates.
+			error = (threadError[i] > error || threadError[i] != threadError[i]) ? threadError[i] : error;
+		}
+
+		threshold = VERIFY_SCALE * n * DBL_EPSILON;
+		printf("Largest backward error: %e (threshold %e) %s\n", error, threshold,
+			(error <= threshold) ? "PASSED" : "FAILED");
+	}
+
+	free(A);
+	free(b);
+	free(x);
+	free(thread);
+	free(threadData);
+	free(threadError);
+
+	return VERIFY == 1 && !(error <= threshold);
+}
+
+// One batch, LANES systems eliminated together, every statement of the
+// scalar algorithm becomes a loop over the lanes that the compiler turns
+// into vector instructions. No pivoting, the same steps as Work().
+static inline __attribute__((always_inline)) void Solve_Kernel(int n, double* restrict A, double* restrict b, double* restrict x)
+{
+	int i, j, k, l;
+	double inverse[LANES] __attribute__((aligned(ALIGNMENT)));
+	double factor[LANES] __attribute__((aligned(ALIGNMENT)));
+	double *pivot, *row;
+
+	for (k = 0; k < n; k++)
+	{
+		pivot = A + (size_t)k * n * LANES;
+
+		for (l = 0; l < LANES; l++)
+		{
+			inverse[l] = 1.0 / pivot[k * LANES + l];
+		}
+
+		// Division step.
+		for (j = k + 1; j < n; j++)
+		{
+			for (l = 0; l < LANES; l++)
+			{
+				pivot[j * LANES + l] *= inverse[l];
+			}
+		}
+
+		for (l = 0; l < LANES; l++)
+		{
+			b[k * LANES + l] *= inverse[l];
+		}
+
+		// Elimination step.
+		for (i = k + 1; i < n; i++)
+		{
+			row = A + (size_t)i * n * LANES;
+
+			for (l = 0; l < LANES; l++)
+			{
+				factor[l] = row[k * LANES + l];
+			}
+
+			for (j = k + 1; j < n; j++)
+			{
+				for (l = 0; l < LANES; l++)
+				{
+					row[j * LANES + l] -= factor[l] * pivot[j * LANES + l];
+				}
+			}
+
+			for (l = 0; l < LANES; l++)
+			{
+				b[i * LANES + l] -= factor[l] * b[k * LANES + l];
+			}
+		}
+	}
+
+	// Back substitution, U is unit upper triangular.
+	for (i = n - 1; i >= 0; i--)
+	{
+		row = A + (size_t)i * n * LANES;
+
+		for (l = 0; l < LANES; l++)
+		{
+			x[i * LANES + l] = b[i * LANES + l];
+		}
+
+		for (j = i + 1; j < n; j++)
+		{
+			for (l = 0; l < LANES; l++)
+			{
+				x[i * LANES + l] -= row[j * LANES + l] * x[j * LANES + l];
+			}
+		}
+	}
+}
+
+void Solve_Generic(int size, double* A, double* b, double* x)
+{
+	Solve_Kernel(size, A, b, x);
+}
+
+// The same kernel with n a constant, so the loops are fully unrolled (or
+// at least have fixed trip counts) for the common sizes.
+#define SOLVE_FIXED(N) \
+void Solve_##N(int size, double* A, double* b, double* x) \
+{ \
+	(void)size; \
+	Solve_Kernel(N, A, b, x); \
+}
+
+SOLVE_FIXED(4)
+SOLVE_FIXED(8)
+SOLVE_FIXED(16)
+SOLVE_FIXED(32)
+SOLVE_FIXED(64)
+
+void Fork_Join(void* (*work)(void*))
+{
+	int i;
+
+	// Whole batches split evenly over the threads, once per run.
+	for (i = 0; i < THREADS; i++)
+	{
+		threadData[i].id = i;
+		threadData[i].start = batches * i / THREADS;
+		threadData[i].stop = batches * (i + 1) / THREADS;
+		pthread_create(&thread[i], NULL, work, (void*)&threadData[i]);
+	}
+
+	for (i = 0; i < THREADS; i++)
+	{
+		pthread_join(thread[i], NULL);
+	}
+}
+
+void* ThreadInitWork(void* input)
+{
+	long p;
+	int i, j, l;
+	ThreadData threadData = *(ThreadData*) input;
+
+	for (p = threadData.start; p < threadData.stop; p++)
+	{
+		for (i = 0; i < n; i++)
+		{
+			for (j = 0; j < n; j++)
+			{
+				for (l = 0; l < LANES; l++)
+				{
+					A[((p * n + i) * n + j) * LANES + l] = Element(p * LANES + l, i, j);
+				}
+			}
+
+			for (l = 0; l < LANES; l++)
+			{
+				b[(p * n + i) * LANES + l] = 2.0;
+				x[(p * n + i) * LANES + l] = 0.0;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+void* ThreadSolveWork(void* input)
+{
+	long p;
+	ThreadData threadData = *(ThreadData*) input;
+
+	for (p = threadData.start; p < threadData.stop; p++)
+	{
+		solver(n, A + (size_t)p * n * n * LANES, b + (size_t)p * n * LANES, x + (size_t)p * n * LANES);
+	}
+
+	return NULL;
+}
+
+void* ThreadVerifyWork(void* input)
+{
+	long p, s;
+	int i, j, l;
+	double sum, rowSum, value, rnorm, anorm, xnorm, error, worst = 0.0;
+	ThreadData threadData = *(ThreadData*) input;
+
+	// Normwise backward error of every system, A is generated again.
+	for (p = threadData.start; p < threadData.stop; p++)
+	{
+		for (l = 0; l < LANES; l++)
+		{
+			s = p * LANES + l;
+
+			// Padding lanes are solved with the batch but not counted.
+			if (s >= systems)
+			{
+				break;
+			}
+
+			rnorm = anorm = xnorm = 0.0;
+
+			for (i = 0; i < n; i++)
+			{
+				sum = 0.0;
+				rowSum = 0.0;
+
+				for (j = 0; j < n; j++)
+				{
+					value = Element(s, i, j);
+					sum += value * x[(p * n + j) * LANES + l];
+					rowSum += (value < 0.0) ? -value : value;
+				}
+
+				value = x[(p * n + i) * LANES + l];
+				sum = (2.0 > sum) ? 2.0 - sum : sum - 2.0;
+				rnorm = (sum > rnorm || sum != sum) ? sum : rnorm;
+				anorm = (rowSum > anorm) ? rowSum : anorm;
+				xnorm = (value > xnorm) ? value : ((-value > xnorm) ? -value : xnorm);
+			}
+
+			error = rnorm / (anorm * xnorm + 2.0);
+			worst = (error > worst || error != error) ? error : worst;
+		}
+	}
+
+	threadError[threadData.id] = worst;
+
+	return NULL;
+}
+
+double Element(long s, int i, int j)
+{
+	// Element (i, j) of system s, strictly diagonally dominant so every
+	// system can be solved without pivoting.
+	if (i == j)
+	{
+		return (double)(n * maxnum);
+	}
+
+	return (double)(Gauss_Random(seed + s, i, j) % maxnum) + 1.0;
+}
+
+double Now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void Read_Options(int argc, char **argv)
+{
+	while (++argv, --argc > 0)
+	{
+		if (**argv == '-')
+		{
+			switch ( *++*argv )
+			{
+				case 'n':
+					--argc;
+					n = atoi(*++argv);
+				break;
+
+				case 'N':
+					--argc;
+					systems = atol(*++argv);
+				break;
+
+				case 'm':
+					--argc;
+					maxnum = atoi(*++argv);
+				break;
+
+				case 's':
+					--argc;
+					seed = strtoull(*++argv, NULL, 10);
+				break;
+
+				case 't':
+					--argc;
+					THREADS = atoi(*++argv);
+				break;
+
+				case 'g':
+					--argc;
+					GENERIC = atoi(*++argv);
+				break;
+
+				case 'V':
+					--argc;
+					VERIFY = atoi(*++argv);
+				break;
+
+				case 'h':
+				case 'u':
+					printf("\nUsage: batched [-n size] size of each system, 1..%d \n", MAX_SIZE);
+					printf("           [-N systems] number of systems, 0 = 256 MB of matrices \n");
+					printf("           [-m maxnum] max random no \n");
+					printf("           [-s seed] seed of the matrices \n");
+					printf("           [-t threads] number of threads, 0 = online CPUs \n");
+					printf("           [-g generic] 0/1, 1 = no fixed size kernel \n");
+					printf("           [-V verify] 0/1 \n");
+					exit(0);
+				break;
+
+				default:
+					printf("%s: ignored option: -%s\n", "batched", *argv);
+					printf("HELP: try %s -u \n\n", "batched");
+				break;
+			}
+		}
+	}
+}
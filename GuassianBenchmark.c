@@ -0,0 +1,396 @@
+//==================================================//
+//		    GAUSSIAN ELIMINATION BENCHMARK			//
+//==================================================//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SIZES 32
+#define MAX_THREADS 32
+#define MAX_REPEATS 100
+#define MAX_RESULTS (MAX_SIZES * (MAX_THREADS + 1))
+#define LINE_LENGTH 512
+
+// One row of the CSV, the sequential program has threads = 0.
+typedef struct
+{
+	char program[16];
+	int n;
+	int threads;
+	char kernel[16];
+	double median;
+	double min;
+	double max;
+	double gflops;
+	double speedup;
+	double efficiency;
+} Result;
+
+int sizes[MAX_SIZES];			// N of the grid.
+int sizeCount;
+int threads[MAX_THREADS];		// thread counts of the grid.
+int threadCount;
+int repeats;					// timed runs per point.
+int warmups;					// untimed runs per point.
+char *Kernel;					// kernel of the parallel program.
+char *Sequential;				// sequential program.
+char *Parallel;					// parallel program.
+char *Extra;					// extra options for both programs.
+char *BaselineFile;				// stored results to compare with.
+char *OutFile;					// CSV output, stdout if NULL.
+double tolerance;				// allowed GFLOP/s drop below the baseline in percent.
+
+Result results[MAX_RESULTS];
+int resultCount;
+
+int Parse_List(char*, int*, int);
+double Run(char*, int, int);
+int Compare_Doubles(const void*, const void*);
+void Measure(char*, int, int, Result*);
+void Write_Results(FILE*);
+int Check_Baseline(void);
+void Read_Options(int, char **);
+
+void Init_Default()
+{
+	sizeCount = Parse_List("512,1024,2048", sizes, MAX_SIZES);
+	threadCount = Parse_List("1,2,4,8", threads, MAX_THREADS);
+	repeats = 5;
+	warmups = 1;
+	Kernel = "fork";
+	Sequential = "./gauss_seq";
+	Parallel = "./gauss";
+	Extra = "";
+	BaselineFile = NULL;
+	OutFile = NULL;
+	tolerance = 10.0;
+}
+
+int main(int argc, char **argv)
+{
+	int i, j;
+	FILE *file = stdout;
+	Result *sequential;
+
+	// Init default values.
+	Init_Default();
+
+	// Read arguments.
+	Read_Options(argc, argv);
+
+	for (i = 0; i < sizeCount; i++)
+	{
+		// Sequential reference of this N.
+		sequential = &results[resultCount++];
+		Measure(Sequential, sizes[i], 0, sequential);
+
+		for (j = 0; j < threadCount; j++)
+		{
+			Result *result = &results[resultCount++];
+
+			Measure(Parallel, sizes[i], threads[j], result);
+			result->speedup = sequential->median / result->median;
+			result->efficiency = result->speedup / threads[j];
+		}
+	}
+
+	if (OutFile != NULL)
+	{
+		file = fopen(OutFile, "w");
+
+		if (file == NULL)
+		{
+			perror(OutFile);
+			exit(1);
+		}
+	}
+
+	Write_Results(file);
+
+	if (file != stdout)
+	{
+		fclose(file);
+	}
+
+	return BaselineFile != NULL ? Check_Baseline() : 0;
+}
+
+int Parse_List(char* list, int* values, int max)
+{
+	int count = 0;
+	char *end;
+
+	// Comma separated integers, e.g. "512,1024,2048".
+	while (*list != '\0' && count < max)
+	{
+		values[count++] = strtol(list, &end, 10);
+
+		if (end == list || (*end != ',' && *end != '\0'))
+		{
+			fprintf(stderr, "Bad list entry: %s\n", list);
+			exit(1);
+		}
+
+		list = (*end == ',') ? end + 1 : end;
+	}
+
+	return count;
+}
+
+double Run(char* program, int n, int t)
+{
+	char command[LINE_LENGTH], line[LINE_LENGTH];
+	double time = -1.0;
+	FILE *pipe;
+
+	// Verification runs after the timed section, skip it to save wall time.
+	if (t == 0)
+	{
+		snprintf(command, sizeof(command), "%s -n %d -V 0 %s", program, n, Extra);
+	}
+
+	else
+	{
+		snprintf(command, sizeof(command), "%s -n %d -t %d -K %s -V 0 %s", program, n, t, Kernel, Extra);
+	}
+
+	pipe = popen(command, "r");
+
+	if (pipe == NULL)
+	{
+		perror(command);
+		exit(1);
+	}
+
+	// "Execution time" is the elimination, the part the FLOP count covers.
+	while (fgets(line, sizeof(line), pipe) != NULL)
+	{
+		sscanf(line, "Execution time: %lf", &time);
+	}
+
+	if (pclose(pipe) != 0 || time < 0.0)
+	{
+		fprintf(stderr, "Failed: %s\n", command);
+		exit(1);
+	}
+
+	return time;
+}
+
+int Compare_Doubles(const void* left, const void* right)
+{
+	double a = *(const double*) left, b = *(const double*) right;
+
+	return (a > b) - (a < b);
+}
+
+void Measure(char* program, int n, int t, Result* result)
+{
+	double times[MAX_REPEATS];
+	int i;
+
+	for (i = 0; i < warmups; i++)
+	{
+		Run(program, n, t);
+	}
+
+	for (i = 0; i < repeats; i++)
+	{
+		times[i] = Run(program, n, t);
+	}
+
+	qsort(times, repeats, sizeof(double), Compare_Doubles);
+
+	// Median of the timed runs, the mean of the middle two for an even count.
+	strcpy(result->program, t == 0 ? "sequential" : "parallel");
+	strcpy(result->kernel, t == 0 ? "-" : Kernel);
+	result->n = n;
+	result->threads = t;
+	result->median = (times[(repeats - 1) / 2] + times[repeats / 2]) / 2.0;
+	result->min = times[0];
+	result->max = times[repeats - 1];
+	result->gflops = 2.0 * n * (double)n * n / 3.0 / result->median / 1e9;
+	result->speedup = 1.0;
+	result->efficiency = 1.0;
+
+	fprintf(stderr, "%s n=%d threads=%d: %f s, %.3f GFLOP/s\n", result->program, n, t, result->median, result->gflops);
+}
+
+void Write_Results(FILE* file)
+{
+	int i;
+
+	fprintf(file, "program,n,threads,kernel,median,min,max,gflops,speedup,efficiency\n");
+
+	for (i = 0; i < resultCount; i++)
+	{
+		Result *r = &results[i];
+
+		fprintf(file, "%s,%d,%d,%s,%f,%f,%f,%f,%f,%f\n", r->program, r->n, r->threads, r->kernel,
+			r->median, r->min, r->max, r->gflops, r->speedup, r->efficiency);
+	}
+}
+
+int Check_Baseline(void)
+{
+	char line[LINE_LENGTH];
+	Result base;
+	int i, found, compared = 0, failed = 0;
+	int matched[MAX_RESULTS] = {0};
+	FILE *file = fopen(BaselineFile, "r");
+
+	if (file == NULL)
+	{
+		perror(BaselineFile);
+		return 1;
+	}
+
+	// The baseline is an earlier CSV output, points only in one of the two
+	// are reported and not compared.
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		if (sscanf(line, "%15[^,],%d,%d,%15[^,],%lf,%lf,%lf,%lf", base.program, &base.n, &base.threads,
+			base.kernel, &base.median, &base.min, &base.max, &base.gflops) != 8)
+		{
+			continue;
+		}
+
+		found = 0;
+
+		for (i = 0; i < resultCount; i++)
+		{
+			Result *r = &results[i];
+
+			if (strcmp(r->program, base.program) != 0 || strcmp(r->kernel, base.kernel) != 0
+				|| r->n != base.n || r->threads != base.threads)
+			{
+				continue;
+			}
+
+			found = 1;
+			matched[i] = 1;
+			compared++;
+
+			if (r->gflops < base.gflops * (1.0 - tolerance / 100.0))
+			{
+				fprintf(stderr, "REGRESSION %s n=%d threads=%d: %.3f GFLOP/s, baseline %.3f (%.1f%% lower)\n",
+					r->program, r->n, r->threads, r->gflops, base.gflops, 100.0 * (1.0 - r->gflops / base.gflops));
+				failed = 1;
+			}
+		}
+
+		if (!found)
+		{
+			fprintf(stderr, "NOT RUN %s n=%d threads=%d kernel=%s is only in the baseline\n",
+				base.program, base.n, base.threads, base.kernel);
+		}
+	}
+
+	fclose(file);
+
+	for (i = 0; i < resultCount; i++)
+	{
+		if (!matched[i])
+		{
+			fprintf(stderr, "NO BASELINE %s n=%d threads=%d kernel=%s\n",
+				results[i].program, results[i].n, results[i].threads, results[i].kernel);
+		}
+	}
+
+	if (compared == 0)
+	{
+		fprintf(stderr, "No point of %s matches this run, nothing was compared.\n", BaselineFile);
+		failed = 1;
+	}
+
+	return failed;
+}
+
+void Read_Options(int argc, char **argv)
+{
+	while (++argv, --argc > 0)
+	{
+		if (**argv == '-')
+		{
+			switch ( *++*argv )
+			{
+				case 'n':
+					--argc;
+					sizeCount = Parse_List(*++argv, sizes, MAX_SIZES);
+				break;
+
+				case 't':
+					--argc;
+					threadCount = Parse_List(*++argv, threads, MAX_THREADS);
+				break;
+
+				case 'r':
+					--argc;
+					repeats = atoi(*++argv);
+					repeats = repeats < 1 ? 1 : (repeats > MAX_REPEATS ? MAX_REPEATS : repeats);
+				break;
+
+				case 'w':
+					--argc;
+					warmups = atoi(*++argv);
+				break;
+
+				case 'K':
+					--argc;
+					Kernel = *++argv;
+				break;
+
+				case 'S':
+					--argc;
+					Sequential = *++argv;
+				break;
+
+				case 'p':
+					--argc;
+					Parallel = *++argv;
+				break;
+
+				case 'x':
+					--argc;
+					Extra = *++argv;
+				break;
+
+				case 'b':
+					--argc;
+					BaselineFile = *++argv;
+				break;
+
+				case 'o':
+					--argc;
+					OutFile = *++argv;
+				break;
+
+				case 'd':
+					--argc;
+					tolerance = atof(*++argv);
+				break;
+
+				case 'h':
+				case 'u':
+					printf("\nUsage: bench [-n sizes] comma separated list of N \n");
+					printf("           [-t threads] comma separated list of thread counts \n");
+					printf("           [-r repeats] timed runs per point \n");
+					printf("           [-w warmups] untimed runs per point \n");
+					printf("           [-K kernel] kernel of the parallel program \n");
+					printf("           [-S program] sequential program \n");
+					printf("           [-p program] parallel program \n");
+					printf("           [-x options] extra options for both programs \n");
+					printf("           [-o file] write the CSV to file \n");
+					printf("           [-b file] baseline CSV to compare with \n");
+					printf("           [-d percent] allowed GFLOP/s drop below the baseline \n");
+					exit(0);
+				break;
+
+				default:
+					printf("%s: ignored option: -%s\n", "bench", *argv);
+					printf("HELP: try %s -u \n\n", "bench");
+				break;
+			}
+		}
+	}
+}
@@ -1,255 +1,4868 @@
 //==================================================//
 //		    PARALLELL GAUSSIAN ELIMINATION			//
 //==================================================//
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <float.h>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 #include <mpi.h>
+#include "GuassianSolver.h"
 
-#define MAX_SIZE 2048
-#define THREADS 8
+#define DEFAULT_SIZE 2048
 
-typedef double matrix[MAX_SIZE][MAX_SIZE];
+// Rows per block in the back substitution.
+#define BACK_BLOCK 64
+
+// Spins on a ready flag before a waiting thread starts yielding its core.
+#define SPIN_LIMIT 1000
+
+// Default tile size of the tiled kernel, and the most tiles per dimension.
+#define TILE_SIZE 128
+#define MAX_TILES 256
+
+// Recursive kernel, panels this narrow are factored directly, and updates
+// with more multiply-adds than REC_PARALLEL are split over the threads.
+#define REC_BASE 8
+#define REC_GEMM_BASE 64
+#define REC_PARALLEL (1 << 21)
+
+// Rows per block in the multiple right hand side solve.
+#define SOLVE_BLOCK 64
+
+// Most refinement iterations of the mixed precision solve.
+#define MAX_REFINE 30
+
+// Verification passes if the backward error is below VERIFY_SCALE * N * eps.
+#define VERIFY_SCALE 10.0
+
+// Matrix storage alignment, rows start on a cache line.
+#define ALIGNMENT 64
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// Binary matrix files, a header page followed by the data.
+#define FILE_MAGIC "GAUSSBIN"
+#define FILE_HEADER_SIZE 4096
+
+// Bytes formatted before Print_Matrix() writes a chunk.
+#define PRINT_CHUNK (64 * 1024)
+
+// Hardware counters of the trace, cycles, instructions and LLC misses.
+#define COUNTERS 3
+
+// Auto-tuning, calibration runs of TUNE_SIZE (or N if smaller), best of
+// TUNE_RUNS each.
+#define TUNE_SIZE 512
+#define TUNE_RUNS 2
+
+// Checkpoint files, a header page followed by the local rows, b and y.
+#define CHECKPOINT_MAGIC "GAUSSCKP"
+
+// Sparse kernel, nested dissection numbers subsets this small directly, and
+// the pseudo-peripheral node search restarts at most PERIPHERAL_TRIES times.
+#define DISSECT_LEAF 64
+#define PERIPHERAL_TRIES 4
+#define DEGREE(v) (spAdjPtr[(v) + 1] - spAdjPtr[v])
 
 int	N;					// Matrix size.
 int	maxnum;				// max number of element.
+unsigned long long seed;	// seed of the matrix generator.
 char *Init;				// matrix init type.
+char *Kernel;			// elimination kernel, fork/pipe/tile/band/rec/pool/ooc/sparse.
+int tileSize;			// tile size of the tiled kernel.
+int CHUNK;				// rows per block a thread owns in the fork kernel.
 int PRINT;				// print switch.
-matrix A;				// matrix A.
-double b[MAX_SIZE];		// vector b.
-double y[MAX_SIZE];		// vector y.
+int THREADS;			// number of threads, 0 = online CPUs.
+char *Pinning;			// thread placement, none/compact/scatter.
+int SMT;				// SMT switch, 0 = leave SMT siblings unused.
+char *InFile;			// binary matrix file to solve, NULL = generate.
+char *SparseFile;		// Matrix Market file for the sparse kernel, NULL = generate.
+char *Ordering;			// fill-reducing ordering of the sparse kernel, nd/rcm/none.
+char *OutFile;			// binary file for the solution x.
+char *DumpFile;			// binary file for the generated A and b.
+char *TraceFile;		// Chrome trace of the fork kernel, NULL = off.
+int CHECKPOINT;			// checkpoint every CHECKPOINT pivots, 0 = off.
+char *CheckpointFile;	// base name of the two checkpoint files.
+int RESTART;			// restart switch, resume from the newest checkpoint.
+char *OocFile;			// panel file of the out-of-core kernel.
+int window;				// panels of the out-of-core kernel in memory.
+int TUNE;				// auto-tune switch, calibrate and save the profile.
+char *ProfileFile;		// tuned settings per machine.
+char profilePath[256];	// default ProfileFile in the home directory.
+int HUGE;				// huge page switch, 0 = off, 1 = transparent, 2 = hugetlbfs.
+int KEEP_L;				// keep the multipliers, A holds L (with pivots) and U.
+int RHS;				// number of right hand sides of the block solve.
+int MIXED;				// mixed precision switch, factor in float and refine in double.
+int VERIFY;				// verify switch, check the residual of x against a copy of A and b.
+double **A;				// matrix A (row pointers into A_data).
+double *A_data;			// aligned backing storage of A.
+size_t A_bytes;			// size of A_data in bytes.
+int A_mapped;			// 1 if A_data was mmap:ed.
+double *fileB;			// b inside the mapped input file.
+int stride;				// padded row length of A in doubles.
+double *b;				// vector b.
+double *y;				// vector y.
+double *x;				// solution vector x.
+double **B;				// right hand sides, solved in place into X (N x RHS).
+double *B_data;			// aligned backing storage of B.
+int B_stride;			// padded row length of B in doubles.
+
+// Mixed precision, float factors of A and the refined solution.
+float **Af;
+float *Af_data;
+double *xm;				// refined solution.
+double *r;				// residual b - A xm, then the correction.
+int refineIterations;	// corrections applied.
+
+// Banded kernel, row i of AB holds columns i - KL .. i + KU of A, with
+// A[i][j] at AB[i][j - i + KL]. Without pivoting the fill stays in the band.
+int KL;					// lower bandwidth, -1 = detect from A.
+int KU;					// upper bandwidth, -1 = detect from A.
+double **AB;			// band storage (row pointers into AB_data).
+double *AB_data;		// aligned backing storage of AB.
+pthread_barrier_t bandBarrier;
+
+// Sparse kernel, A in CSR, row i has the columns spCol[spRowPtr[i] ..
+// spRowPtr[i + 1] - 1], and the same entries by column for the factorization.
+// Unknowns are renumbered, new j is old spPerm[j]. Column j of L and row j
+// of U share the sorted pattern spIndex[spLPtr[j] ..] of the reordered
+// A + A^T with its fill, the pivots are in spDiag and U is unit upper.
+int *spRowPtr;
+int *spCol;
+double *spValue;
+int spNnz;
+int spGrid;				// width of the generated grid.
+int *spColPtr;
+int *spRow;
+double *spColValue;
+int *spAdjPtr;			// graph of A + A^T, for the ordering.
+int *spAdj;
+int *spPerm;
+int *spInverse;			// spInverse[spPerm[j]] = j.
+int *spRegionOf;		// subset of each node during the ordering.
+int *spMark;
+int spRegion, spStamp, spNext;
+int *spParent;			// elimination tree, -1 at the roots.
+int spHeight;			// levels of the elimination tree.
+long *spLPtr;
+int *spIndex;
+double *spL;
+double *spU;
+double *spDiag;
+long *spDepPtr;			// row j of L, the columns spDep[spDepPtr[j] ..] and
+int *spDep;				// the position of j in each of them.
+long *spDepPos;
+int *spPending;			// children of each column not done yet.
+int *spQueue;			// ready columns, taken from spHead.
+int spHead, spTail, spDone;
+int spZeroPivot;
+pthread_mutex_t spLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t spReady = PTHREAD_COND_INITIALIZER;
+double spOrderTime, spSymbolicTime, spNumericTime;
+
+// Verification, copies of the local rows of A (or its band) and b.
+double **A0;
+double *A0_data;
+int A0_band;			// 1 if A0 is a copy of the band storage.
+double *b0;
+double (*verifyNorms)[3];	// Per thread max |r|, max row sum |A|, max |b|.
+
+// Binary matrix file header. A file holds rows rows of A (stride elements
+// apart) at a_offset and a vector at b_offset, b for inputs and x for
+// solutions. The data starts page aligned so it can be mapped as is.
+typedef struct
+{
+	char magic[8];
+	int n;
+	int dtype;			// Bytes per element, only 8 (double) for now.
+	int stride;			// Row length of A in elements.
+	int rows;			// Rows of A in the file, 0 for a vector file.
+	long long a_offset;
+	long long b_offset;	// 0 if the file has no vector.
+} FileHeader;
+
+// Checkpoint header, steps below k are complete in the file. k is -1 while
+// a snapshot is being written, so a torn file is never used.
+typedef struct
+{
+	char magic[8];
+	int n;
+	int stride;
+	int rows;
+	int ranks;
+	int rank;
+	int keepL;
+	int k;
+	unsigned long long checksum;	// Of this rank's rows of the original A and b.
+} CheckpointHeader;
+
+// Checkpoints alternate between two files, the other one stays complete
+// while one is written. A file is updated in place, a snapshot at k only
+// writes the part of the local rows that changed since the file's last
+// snapshot at ckptK (rows and columns >= ckptK), plus b and y.
+int ckptFd[2];
+int ckptK[2];			// Last snapshot of each file, 0 = none.
+int ckptNext;			// File of the next snapshot.
+int ckptStep;			// Snapshot being written.
+double *ckptStage;		// Copy of the changed part, written in the background.
+pthread_t ckptThread;
+int ckptWriting;		// 1 while ckptThread runs.
+int ckptCount;			// Snapshots taken.
+double ckptCopyTime;	// Seconds the elimination stopped for the copies.
+unsigned long long ckptChecksum;	// Of the input, taken before step 0.
+long long ckptBytes;	// Bytes written.
+
+// Out-of-core kernel, A lives in OocFile as panels of tileSize columns,
+// panel p column major at p * N * tileSize doubles. window panels are in
+// memory, two stream the factored panels and the rest hold the group of
+// panels being factored.
+int oocFd;
+int panels;				// number of panels.
+double **oocBuffer;		// the window.
+double **oocColumn;		// column c of a panel in the window.
+pthread_t oocThread;	// reads the next panel.
+int oocPanel;			// panel oocThread reads.
+double *oocTarget;		// buffer oocThread reads into.
+long long oocRead;		// bytes read.
+long long oocWritten;	// bytes written.
+double oocWaitTime;		// seconds the elimination waited for reads.
+
+// Print buffer.
+char printBuffer[PRINT_CHUNK + 128];
+int printUsed;
+
+// MPI variables, rows are distributed cyclically, global row g lives on
+// rank g % ranks as local row g / ranks. A, b and y hold local rows only.
+int rank;				// this rank.
+int ranks;				// number of ranks.
+int rows;				// number of local rows.
+double *pivot;			// broadcast buffer, pivot row and y value.
+double *pivotRow;		// pivot row of the current step, indexed by column.
+double pivotY;			// y value of the current step.
+double *z;				// back substitution work vector of the local rows.
+
+// Pipelined kernel, ready[k] is set once row k is normalized.
+int *ready;
+
+// Tiled kernel. Task (i, j, k) applies pivot block k to tile (i, j), the
+// last task of a tile (k == min(i, j)) factors or solves it. Each task
+// counts its unmet dependencies and is pushed when the count reaches zero.
+typedef struct
+{
+	int *tasks;
+	int top;		// Thieves take from here.
+	int bottom;		// The owner pushes and pops here.
+	int capacity;
+	pthread_mutex_t lock;
+} Deque;
+
+// Recursive kernel, column and inner ranges of the current parallel update.
+int recColumn0, recColumn1, recInner0, recInner1;
+
+int tiles;				// tiles per dimension.
+int *taskDeps;			// unmet dependencies of each task.
+int tasksDone;			// completed tasks.
+int tasksTotal;			// number of tasks.
+
+// Thread variables, THREADS of each.
+pthread_t *thread;
+pthread_attr_t *threadAttr;	// Carries the CPU each thread is pinned to.
+typedef struct
+{
+	int id;
+	int k;
+	int start;
+	int stop;
+	int kstop;	// End column (exclusive) of a block step, or the row step.
+} ThreadData;
+
+ThreadData *threadData;
+Deque *deques;
+double *busyTime;	// Seconds each thread spent computing.
+
+// Pool kernel, the solve runs through GuassianSolver.
+Gauss_Pool *pool;
+Gauss_Context solver;
+
+// Trace of the fork kernel, times are seconds since traceOrigin.
+typedef struct
+{
+	double start;
+	double stop;
+} Interval;
+
+Interval *traceSerial;		// Division step (and broadcast) of pivot k.
+Interval *traceStep;		// Fork to join of step k.
+Interval *traceCompute;		// Row updates of step k by thread t, at k * THREADS + t.
+long long *traceCounters;	// Serial then parallel counters of step k, at k * 2 * COUNTERS.
+int counterFd[COUNTERS];	// -1 when the counters are unavailable.
+double traceOrigin;
+
+void Work(void);
+void Work_Library(void);
+void Work_Pipelined(void);
+void* ThreadPipeWork(void*);
+void Normalize_Row(int);
+void Work_Tiled(void);
+void Finish_Factors(void);
+void Work_Recursive(void);
+void Rec_LU(int, int);
+void Rec_Gemm(int, int, int, int, int, int);
+void* ThreadRecGemmWork(void*);
+void* ThreadRecTrsmWork(void*);
+void* ThreadTileWork(void*);
+void Tile_Run(int);
+void Tile_Release(int, int);
+int Tile_Task(int, int, int);
+void Deque_Push(Deque*, int);
+int Deque_Pop(Deque*);
+int Deque_Steal(Deque*);
+void Setup_Threads(void);
+int Read_Topology(int, char*);
+int Compare_CPUs(const void*, const void*);
+void Fork_Join(void* (*)(void*), int, int, int, int);
+void Fork_Join_Owned(void* (*)(void*), int, int, int);
+int Next_Owned_Row(int);
+void* ThreadWork(void*);
+void Trace_Begin(void);
+void Trace_Counters(long long*);
+void Trace_End(void);
+void Checkpoint_Open(void);
+int Checkpoint_Restore(void);
+unsigned long long Checkpoint_Checksum(void);
+void Checkpoint_Save(int);
+void* Checkpoint_Writer(void*);
+void Checkpoint_Finish(void);
+void Allocate_Out_Of_Core(void);
+void Init_Out_Of_Core(void);
+void* ThreadOocInitWork(void*);
+void Work_Out_Of_Core(void);
+void* ThreadOocWork(void*);
+void* ThreadOocRhsWork(void*);
+void Back_Substitution_Out_Of_Core(void);
+void* ThreadOocBackWork(void*);
+void Ooc_Map(int, double*);
+void Ooc_Prefetch(int, double*);
+void Ooc_Wait(void);
+void* Ooc_Read_Work(void*);
+void Ooc_Transfer(int, double*, int);
+double Initial_Value(int, int);
+int First_Local_Row(int);
+void Back_Substitution(void);
+void Allocate_Band(void);
+void Save_Original(void);
+void* ThreadSaveWork(void*);
+int Verify(void);
+void* ThreadVerifyWork(void*);
+void Map_Matrix(void);
+void Write_File(char*, int, double*);
+void Print_Values(double*, int);
+void Print_Flush(void);
+void Work_Band(void);
+void* ThreadBandWork(void*);
+void Allocate_Sparse(void);
+void Read_Sparse(void);
+void Work_Sparse(void);
+void Sparse_Order(void);
+int Sparse_BFS(int, int, int*, int*, int);
+int Sparse_Peripheral(int, int, int*, int*, int);
+void Sparse_Dissect(int*, int);
+void Sparse_Symbolic(void);
+void* ThreadSparseWork(void*);
+void Sparse_Column(int, double*, double*);
+void Back_Substitution_Sparse(void);
+int Work_Mixed(void);
+void* ThreadFloatWork(void*);
+void* ThreadResidualWork(void*);
+void Float_Solve(double*);
+void Solve_Multiple(void);
+void* ThreadBlockWork(void*);
+void* ThreadBackWork(void*);
+void Allocate_Matrix(void);
+void Free_Matrix(void);
+void Init_Matrix(void);
+void* ThreadInitWork(void*);
+void Print_Matrix(void);
+void Profile_Key(char*, int);
+void Load_Profile(void);
+void Save_Profile(char*, int, int, int);
+void Auto_Tune(char*);
+double Calibrate(char*, char*, int, int, int);
+char* Shell_Quote(char*, size_t, char*);
+void Read_Options(int, char **);
+
+void Init_Default()
+{
+    N = DEFAULT_SIZE;
+    Init = "rand";
+    Kernel = NULL;
+    tileSize = 0;
+    CHUNK = 0;
+    maxnum = 15.0;
+    seed = 1;
+    PRINT = 0;
+    THREADS = 0;
+    Pinning = "none";
+    SMT = 1;
+    HUGE = 0;
+    KEEP_L = 0;
+    RHS = 0;
+    MIXED = 0;
+    VERIFY = 1;
+    KL = -1;
+    KU = -1;
+    InFile = NULL;
+    SparseFile = NULL;
+    Ordering = "nd";
+    OutFile = NULL;
+    DumpFile = NULL;
+    TraceFile = NULL;
+    CHECKPOINT = 0;
+    CheckpointFile = "gauss.ckpt";
+    RESTART = 0;
+    OocFile = "gauss.ooc";
+    window = 8;
+    TUNE = 0;
+    ProfileFile = "gauss.profile";
+
+    if (getenv("HOME") != NULL)
+    {
+        snprintf(profilePath, sizeof(profilePath), "%s/.gauss_profile", getenv("HOME"));
+        ProfileFile = profilePath;
+    }
+}
+
+int main(int argc, char **argv)
+{
+	MPI_Init(&argc, &argv);
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+	double start_time, mid_time, end_time, mixed_time = 0.0;
+	int converged = 0, failed = 0;
+
+    int i;
+
+	// Init default values.
+    Init_Default();
+
+	// Read arguments.
+    Read_Options(argc, argv);
+
+	// Kernel, threads and tile size not given as options come from the
+	// profile of this machine, calibrated now with -A 1.
+	if (TUNE == 1 && ranks == 1)
+	{
+		Auto_Tune(argv[0]);
+	}
+
+	Load_Profile();
+	Kernel = (Kernel == NULL) ? "fork" : Kernel;
+	tileSize = (tileSize <= 0) ? TILE_SIZE : tileSize;
+	CHUNK = (CHUNK <= 0) ? 1 : CHUNK;
+
+	// Thread count and placement.
+	Setup_Threads();
+
+	if (RHS > 0)
+	{
+		// The block solve needs the factors.
+		KEEP_L = 1;
+	}
+
+	if (InFile != NULL)
+	{
+		Init = "file";
+	}
+
+	if (SparseFile != NULL)
+	{
+		Init = "sparse";
+	}
+
+	if (strcmp(Init, "sparse") == 0)
+	{
+		// A sparse input only exists in CSR storage.
+		Kernel = "sparse";
+	}
+
+	if (strcmp(Kernel, "sparse") == 0)
+	{
+		// The factors are in the sparse storage, not in A.
+		RHS = 0;
+		MIXED = 0;
+		KEEP_L = 0;
+
+		if (ranks > 1)
+		{
+			if (rank == 0)
+			{
+				printf("The sparse kernel runs on one rank.\n");
+			}
+
+			MPI_Finalize();
+			exit(1);
+		}
+	}
+
+	if (strcmp(Init, "band") == 0)
+	{
+		// A banded input only exists in band storage.
+		Kernel = "band";
+		RHS = 0;
+		MIXED = 0;
+	}
+
+	if (strcmp(Kernel, "ooc") == 0)
+	{
+		// A is generated into the panel file, the kernel keeps L on disk.
+		RHS = 0;
+		MIXED = 0;
+		window = (window < 3) ? 3 : window;
+
+		if (ranks > 1 || InFile != NULL)
+		{
+			if (rank == 0)
+			{
+				printf("The out-of-core kernel runs on one rank with a generated matrix.\n");
+			}
+
+			MPI_Finalize();
+			exit(1);
+		}
+	}
+
+	if (ranks > 1 && (strcmp(Kernel, "band") == 0 || strcmp(Kernel, "pipe") == 0 || strcmp(Kernel, "tile") == 0 ||
+		strcmp(Kernel, "rec") == 0 || strcmp(Kernel, "pool") == 0))
+	{
+		// Only the fork kernel distributes the rows over the ranks.
+		if (rank == 0)
+		{
+			printf("The %s kernel runs on one rank.\n", Kernel);
+		}
+
+		MPI_Finalize();
+		exit(1);
+	}
+
+	// Allocate and init the matrix.
+	Allocate_Matrix();
+    Init_Matrix();
+
+	if (DumpFile != NULL && ranks == 1 && AB == NULL && spRowPtr == NULL)
+	{
+		// Save the input, it can be solved again with -f.
+		Write_File(DumpFile, N, b);
+	}
+
+	if (VERIFY == 1)
+	{
+		Save_Original();
+	}
+
+	if (MIXED == 1 && ranks == 1)
+	{
+		// Mixed precision solve first, it leaves A and b untouched so the
+		// double path below can be timed against it.
+		mixed_time = MPI_Wtime();
+		converged = Work_Mixed();
+		mixed_time = MPI_Wtime() - mixed_time;
+	}
+
+	if (TraceFile != NULL)
+	{
+		// Only the fork kernel is instrumented.
+		if (strcmp(Kernel, "fork") == 0 || ranks > 1)
+		{
+			Trace_Begin();
+		}
+
+		else if (rank == 0)
+		{
+			printf("Trace: only the fork kernel is traced, ignoring -T.\n");
+		}
+	}
+
+	if ((CHECKPOINT > 0 || RESTART == 1) && strcmp(Kernel, "fork") != 0 && ranks == 1)
+	{
+		// Only the fork kernel's steps leave a state that can be saved.
+		printf("Checkpoint: only the fork kernel is checkpointed, ignoring -C and -r.\n");
+		CHECKPOINT = 0;
+		RESTART = 0;
+	}
+
+	if (strcmp(Kernel, "pool") == 0 && ranks == 1)
+	{
+		// Workers are started once, outside the timed solve.
+		pool = Gauss_Pool_Create(THREADS);
+
+		if (pool == NULL)
+		{
+			printf("Could not start %d pool workers.\n", THREADS);
+			exit(1);
+		}
+	}
+
+	// Start timer.
+	MPI_Barrier(MPI_COMM_WORLD);
+	start_time = MPI_Wtime();
+
+	// Do guassian elimination.
+    Work();
+
+	mid_time = MPI_Wtime();
+
+	// Solve the triangular system for x.
+	Back_Substitution();
+
+	// Stop timer.
+	MPI_Barrier(MPI_COMM_WORLD);
+	end_time = MPI_Wtime();
+
+	if (RHS > 0 && ranks == 1)
+	{
+		// Reuse the factors for a block of right hand sides.
+		double solve_time = MPI_Wtime();
+		Solve_Multiple();
+		solve_time = MPI_Wtime() - solve_time;
+
+		printf("Block solve time (%d right hand sides): %f\n", RHS, solve_time);
+		printf("Time per right hand side: %f (%f with the factorization)\n",
+			solve_time / RHS, (solve_time + mid_time - start_time) / RHS);
+	}
+
+    if (PRINT == 1 && ranks == 1)
+	{
+		printf("===== AFTER GUASSIAN ELIMINATION ======\n");
+		Print_Matrix();
+		printf("=======================================\n\n");
+	}
+
+	else if (PRINT == 1 && rank == 0)
+	{
+		// The matrix is distributed, only the solution is printed.
+		printf("\nVector x:\n[");
+
+		for (i = 0; i < N; i++)
+		{
+			printf(" %5.2f,", x[i]);
+		}
+
+		printf("]\n\n");
+	}
+
+	if (OutFile != NULL && rank == 0)
+	{
+		Write_File(OutFile, 0, x);
+	}
+
+	if (VERIFY == 1)
+	{
+		failed = Verify();
+	}
+
+	if (traceSerial != NULL)
+	{
+		Trace_End();
+	}
+
+	if (rank == 0)
+	{
+		double time_taken = (mid_time - start_time);
+		double busy = 0.0;
+
+		for (i = 0; i < THREADS; i++)
+		{
+			busy += busyTime[i];
+		}
+
+		printf("Execution time: %f\n", time_taken);
+
+		if (oocBuffer != NULL)
+		{
+			printf("Out-of-core I/O: %lld bytes read, %lld bytes written, %f seconds waiting for reads\n",
+				oocRead, oocWritten, oocWaitTime);
+		}
+
+		if (spDiag != NULL)
+		{
+			printf("Sparse: ordering %f, symbolic %f, numeric %f seconds\n", spOrderTime, spSymbolicTime, spNumericTime);
+			printf("Sparse: nnz(A) %d, nnz(L+U) %ld (fill %.2f), elimination tree height %d%s\n", spNnz,
+				2 * spLPtr[N] + N, (2.0 * spLPtr[N] + N) / (spNnz > 0 ? spNnz : 1), spHeight,
+				spZeroPivot ? ", zero pivot" : "");
+		}
+
+		// The pool workers live in the library and are not timed.
+		if (strcmp(Kernel, "pool") != 0)
+		{
+			printf("Core utilization: %.1f%%\n", 100.0 * busy / (time_taken * THREADS));
+		}
+
+		printf("Back substitution time: %f\n", end_time - mid_time);
+		printf("Total solve time: %f\n", end_time - start_time);
+
+		if (MIXED == 1 && ranks == 1)
+		{
+			double difference = 0.0;
+
+			if (converged)
+			{
+				for (i = 0; i < N; i++)
+				{
+					if (xm[i] - x[i] > difference || x[i] - xm[i] > difference)
+					{
+						difference = (xm[i] > x[i]) ? xm[i] - x[i] : x[i] - xm[i];
+					}
+				}
+
+				printf("Mixed precision time: %f (%d refinement iterations)\n", mixed_time, refineIterations);
+				printf("Max difference to the double solution: %e\n", difference);
+			}
+
+			else
+			{
+				// The double path above is the fallback.
+				mixed_time += end_time - start_time;
+				printf("Refinement stalled after %d iterations, fell back to double.\n", refineIterations);
+				printf("Mixed precision time: %f\n", mixed_time);
+			}
+
+			printf("Speedup over double: %.2f\n", (end_time - start_time) / mixed_time);
+			free(xm);
+			free(r);
+		}
+	}
+
+	if (pool != NULL)
+	{
+		Gauss_Pool_Destroy(pool);
+	}
+
+	Free_Matrix();
+	MPI_Finalize();
+
+	return failed;
+}
+
+void Work(void)
+{
+    int j, k, kl, k0 = 0;
+
+	if (strcmp(Kernel, "pipe") == 0 && ranks == 1)
+	{
+		Work_Pipelined();
+		return;
+	}
+
+	if (strcmp(Kernel, "tile") == 0 && ranks == 1)
+	{
+		Work_Tiled();
+		return;
+	}
+
+	if (strcmp(Kernel, "band") == 0 && ranks == 1)
+	{
+		Work_Band();
+		return;
+	}
+
+	if (strcmp(Kernel, "sparse") == 0)
+	{
+		Work_Sparse();
+		return;
+	}
+
+	if (strcmp(Kernel, "rec") == 0 && ranks == 1)
+	{
+		Work_Recursive();
+		return;
+	}
+
+	if (strcmp(Kernel, "pool") == 0 && ranks == 1)
+	{
+		Work_Library();
+		return;
+	}
+
+	if (strcmp(Kernel, "ooc") == 0)
+	{
+		Work_Out_Of_Core();
+		return;
+	}
+
+	if (CHECKPOINT > 0 || RESTART == 1)
+	{
+		// A and b are still the input here, whatever the seed, -I, -m or -f.
+		ckptChecksum = Checkpoint_Checksum();
+	}
+
+	if (RESTART == 1)
+	{
+		k0 = Checkpoint_Restore();
+	}
+
+    // Gaussian elimination algorithm, Algo 8.4 from Grama.
+    for (k = k0; k < N; k++) 
+	{
+		kl = k / ranks;
+
+		if (CHECKPOINT > 0 && k > k0 && k % CHECKPOINT == 0)
+		{
+			// Steps below k are done, snapshot them.
+			Checkpoint_Save(k);
+		}
+
+		if (traceSerial != NULL)
+		{
+			Trace_Counters(&traceCounters[k * 2 * COUNTERS]);
+			traceSerial[k].start = MPI_Wtime() - traceOrigin;
+		}
+
+		if (k % ranks == rank)
+		{
+			for (j = k+1; j < N; j++)
+			{
+				// Division step.
+				A[kl][j] = A[kl][j] / A[kl][k]; 
+			}
+
+			y[kl] = b[kl] / A[kl][k];
+
+			if (KEEP_L == 0)
+			{
+				A[kl][k] = 1.0;
+			}
+		}
+
+		if (ranks > 1)
+		{
+			// Broadcast the normalized pivot row and its y value from the owner.
+			if (k % ranks == rank)
+			{
+				memcpy(&pivot[k + 1], &A[kl][k + 1], (N - (k + 1)) * sizeof(double));
+				pivot[N] = y[kl];
+			}
+
+			MPI_Bcast(&pivot[k + 1], N - k, MPI_DOUBLE, k % ranks, MPI_COMM_WORLD);
+			pivotRow = pivot;
+			pivotY = pivot[N];
+		}
+
+		else
+		{
+			pivotRow = A[k];
+			pivotY = y[k];
+		}
+
+		if (traceSerial != NULL)
+		{
+			traceSerial[k].stop = traceStep[k].start = MPI_Wtime() - traceOrigin;
+			Trace_Counters(&traceCounters[k * 2 * COUNTERS + COUNTERS]);
+		}
+
+		// Thread the elimination step over the local rows below the pivot.
+		Fork_Join_Owned(ThreadWork, k, First_Local_Row(k + 1), rows);
+
+		if (traceSerial != NULL)
+		{
+			traceStep[k].stop = MPI_Wtime() - traceOrigin;
+		}
+    }
+
+	if (traceSerial != NULL)
+	{
+		// Closing reading, the counts of the last step end here.
+		Trace_Counters(&traceCounters[N * 2 * COUNTERS]);
+	}
+
+	if (CHECKPOINT > 0 || RESTART == 1)
+	{
+		Checkpoint_Finish();
+	}
+}
+
+void Checkpoint_Open(void)
+{
+	char name[256];
+	int f;
+	size_t size = FILE_HEADER_SIZE + ((size_t)rows * stride + 2 * (size_t)rows) * sizeof(double);
+
+	// name.0 and name.1, with MPI each rank has its own pair.
+	for (f = 0; f < 2; f++)
+	{
+		if (ranks > 1)
+		{
+			snprintf(name, sizeof(name), "%s.%d.%d", CheckpointFile, f, rank);
+		}
+
+		else
+		{
+			snprintf(name, sizeof(name), "%s.%d", CheckpointFile, f);
+		}
+
+		ckptFd[f] = open(name, O_RDWR | O_CREAT, 0644);
+
+		if (ckptFd[f] < 0 || ftruncate(ckptFd[f], size) != 0)
+		{
+			perror(name);
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+
+		ckptK[f] = 0;
+	}
+
+	ckptNext = 0;
+	ckptStage = malloc(((size_t)rows * N + 2 * (size_t)rows) * sizeof(double));
+}
+
+int Checkpoint_Restore(void)
+{
+	CheckpointHeader header;
+	int f, i, k = 0, best = -1, have, all, mine[2] = { -1, -1 };
+	int candidates[2], tries, other = 0, any;
+	size_t offset;
+
+	Checkpoint_Open();
+
+	// Valid snapshots of this system on this rank. A snapshot of another
+	// matrix (seed, -I, -m or input file) must not be finished as this one.
+	for (f = 0; f < 2; f++)
+	{
+		if (pread(ckptFd[f], &header, sizeof(header), 0) != sizeof(header) ||
+			memcmp(header.magic, CHECKPOINT_MAGIC, 8) != 0 || header.k <= 0)
+		{
+			continue;
+		}
+
+		if (header.n == N && header.stride == stride && header.rows == rows && header.ranks == ranks &&
+			header.rank == rank && header.keepL == KEEP_L && header.checksum == ckptChecksum)
+		{
+			mine[f] = header.k;
+			ckptK[f] = header.k;
+		}
+
+		else
+		{
+			other = 1;
+		}
+	}
+
+	MPI_Allreduce(&other, &any, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+
+	if (any)
+	{
+		if (rank == 0)
+		{
+			printf("%s holds a checkpoint of a different system or run setup, not restoring it.\n", CheckpointFile);
+		}
+
+		MPI_Finalize();
+		exit(1);
+	}
+
+	// The ranks resume from the newest step every rank has, the smallest of
+	// the newest ones, or failing that the smallest of the oldest ones.
+	candidates[0] = (mine[0] > mine[1]) ? mine[0] : mine[1];
+	candidates[1] = (mine[0] >= 0 && mine[1] >= 0 && mine[0] > mine[1]) ? mine[1] : mine[0];
+	candidates[1] = (candidates[1] < 0) ? candidates[0] : candidates[1];
+
+	for (tries = 0; tries < 2 && best < 0; tries++)
+	{
+		MPI_Allreduce(&candidates[tries], &k, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+		have = (k > 0 && (mine[0] == k || mine[1] == k));
+		MPI_Allreduce(&have, &all, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+
+		if (all)
+		{
+			best = (mine[0] == k) ? 0 : 1;
+		}
+	}
+
+	if (best < 0)
+	{
+		if (rank == 0)
+		{
+			printf("No checkpoint to restart from, starting at step 0.\n");
+		}
+
+		return 0;
+	}
+
+	for (i = 0; i < rows; i++)
+	{
+		offset = FILE_HEADER_SIZE + (size_t)i * stride * sizeof(double);
+
+		if (pread(ckptFd[best], A[i], N * sizeof(double), offset) != (ssize_t)(N * sizeof(double)))
+		{
+			perror("Checkpoint read");
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+	}
+
+	offset = FILE_HEADER_SIZE + (size_t)rows * stride * sizeof(double);
+
+	if (pread(ckptFd[best], b, rows * sizeof(double), offset) != (ssize_t)(rows * sizeof(double)) ||
+		pread(ckptFd[best], y, rows * sizeof(double), offset + rows * sizeof(double)) != (ssize_t)(rows * sizeof(double)))
+	{
+		perror("Checkpoint read");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+
+	// The next snapshot goes to the other file, this one stays as it is.
+	ckptNext = 1 - best;
+
+	if (rank == 0)
+	{
+		printf("Restarted from the checkpoint at step %d.\n", k);
+	}
+
+	return k;
+}
+
+unsigned long long Checkpoint_Checksum(void)
+{
+	int i, j;
+	unsigned long long hash = 0xCBF29CE484222325ULL, bits;
+
+	// FNV-1a over the bit patterns of the local rows of A and of b, one
+	// O(N^2 / ranks) pass before the elimination.
+	for (i = 0; i < rows; i++)
+	{
+		for (j = 0; j <= N; j++)
+		{
+			memcpy(&bits, (j < N) ? &A[i][j] : &b[i], sizeof(bits));
+			hash = (hash ^ bits) * 0x100000001B3ULL;
+		}
+	}
+
+	return hash;
+}
+
+void Checkpoint_Save(int k)
+{
+	int i, first, from;
+	double start_time = MPI_Wtime();
+	double *stage;
+
+	if (ckptStage == NULL)
+	{
+		Checkpoint_Open();
+	}
+
+	// The previous snapshot must be on disk before its stage is reused.
+	if (ckptWriting)
+	{
+		pthread_join(ckptThread, NULL);
+		ckptWriting = 0;
+	}
+
+	// Rows and columns >= from changed since the file's last snapshot.
+	from = ckptK[ckptNext];
+	first = First_Local_Row(from);
+	stage = ckptStage;
+
+	for (i = first; i < rows; i++)
+	{
+		memcpy(stage, &A[i][from], (N - from) * sizeof(double));
+		stage += N - from;
+	}
+
+	memcpy(stage, b, rows * sizeof(double));
+	memcpy(stage + rows, y, rows * sizeof(double));
+
+	ckptStep = k;
+	ckptWriting = 1;
+	ckptCount++;
+	pthread_create(&ckptThread, NULL, Checkpoint_Writer, NULL);
+	ckptCopyTime += MPI_Wtime() - start_time;
+}
+
+void* Checkpoint_Writer(void* input)
+{
+	CheckpointHeader header;
+	int i, fd = ckptFd[ckptNext], from = ckptK[ckptNext];
+	size_t bytes = (N - from) * sizeof(double);
+	double *stage = ckptStage;
+	int ok = 1;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHECKPOINT_MAGIC, 8);
+	header.n = N;
+	header.stride = stride;
+	header.rows = rows;
+	header.ranks = ranks;
+	header.rank = rank;
+	header.keepL = KEEP_L;
+	header.checksum = ckptChecksum;
+
+	// Invalidate, write the changed part, then commit the step.
+	header.k = -1;
+	ok &= pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+	ok &= fdatasync(fd) == 0;
+
+	for (i = First_Local_Row(from); i < rows; i++)
+	{
+		ok &= pwrite(fd, stage, bytes, FILE_HEADER_SIZE + ((size_t)i * stride + from) * sizeof(double)) == (ssize_t)bytes;
+		stage += N - from;
+		ckptBytes += bytes;
+	}
+
+	ok &= pwrite(fd, stage, 2 * rows * sizeof(double), FILE_HEADER_SIZE + (size_t)rows * stride * sizeof(double))
+		== (ssize_t)(2 * rows * sizeof(double));
+	ok &= fdatasync(fd) == 0;
+
+	header.k = ckptStep;
+	ok &= pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+	ok &= fdatasync(fd) == 0;
+	ckptBytes += 2 * rows * sizeof(double) + 2 * sizeof(header);
+
+	if (!ok)
+	{
+		// The other file is still complete, the run goes on without this one.
+		perror("Checkpoint write");
+		return NULL;
+	}
+
+	ckptK[ckptNext] = ckptStep;
+	ckptNext = 1 - ckptNext;
+
+	return NULL;
+}
+
+void Checkpoint_Finish(void)
+{
+	if (ckptWriting)
+	{
+		pthread_join(ckptThread, NULL);
+		ckptWriting = 0;
+	}
+
+	if (rank == 0 && ckptCount > 0)
+	{
+		printf("Checkpoints: %d (every %d steps), %lld bytes written by rank 0, elimination stopped %f seconds for copies\n",
+			ckptCount, CHECKPOINT, ckptBytes, ckptCopyTime);
+	}
+
+	if (ckptStage != NULL)
+	{
+		close(ckptFd[0]);
+		close(ckptFd[1]);
+		free(ckptStage);
+		ckptStage = NULL;
+	}
+}
+
+void Work_Library(void)
+{
+	// A is factored in place by a team of THREADS pool workers, the program
+	// keeps its own back substitution.
+	Gauss_Init(&solver, N, A[0], stride, b, y, x, NULL);
+	solver.keepL = KEEP_L;
+
+	if (Gauss_Factor(&solver, pool, THREADS) == GAUSS_ZERO_PIVOT)
+	{
+		printf("Zero pivot, A has no LU factorization without pivoting.\n");
+	}
+
+	Gauss_Free(&solver);
+}
+
+void Allocate_Out_Of_Core(void)
+{
+	int p;
+	size_t bytes = (size_t)N * tileSize * sizeof(double);
+
+	panels = (N + tileSize - 1) / tileSize;
+	oocFd = open(OocFile, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (oocFd < 0 || ftruncate(oocFd, (off_t)panels * bytes) != 0)
+	{
+		perror(OocFile);
+		exit(1);
+	}
+
+	oocBuffer = malloc(window * sizeof(double*));
+	oocColumn = calloc(N, sizeof(double*));
+
+	for (p = 0; p < window; p++)
+	{
+		if (posix_memalign((void**)&oocBuffer[p], ALIGNMENT, bytes) != 0)
+		{
+			printf("Could not allocate the window of %d panels.\n", window);
+			exit(1);
+		}
+	}
+}
+
+void Init_Out_Of_Core(void)
+{
+	int i, p, width;
+
+	// Generate one panel at a time in the window and write it out.
+	for (p = 0; p < panels; p++)
+	{
+		width = (N - p * tileSize < tileSize) ? N - p * tileSize : tileSize;
+		Ooc_Map(p, oocBuffer[0]);
+		Fork_Join(ThreadOocInitWork, 0, 0, p * tileSize, p * tileSize + width);
+		Ooc_Transfer(p, oocBuffer[0], 1);
+	}
+
+	for (i = 0; i < N; i++)
+	{
+		b[i] = 2.0;
+		y[i] = 1.0;
+	}
+
+	oocRead = 0;
+	oocWritten = 0;
+}
+
+void* ThreadOocInitWork(void* input)
+{
+	int i, j;
+	ThreadData threadData = *(ThreadData*) input;
+
+	for (j = threadData.start; j < threadData.stop; j++)
+	{
+		for (i = 0; i < N; i++)
+		{
+			oocColumn[j][i] = Initial_Value(i, j);
+		}
+	}
+
+	return NULL;
+}
+
+void Work_Out_Of_Core(void)
+{
+	int i, k, p, q, first, last, group = window - 2;
+
+	// Left-looking by groups of panels. The panels left of a group are
+	// streamed through two buffers and their steps applied to the whole
+	// group, while the next one is read in the background. Then the group
+	// is factored in memory step by step. Every column gets the same
+	// updates in the same order as in the fork kernel.
+	for (p = 0; p < panels; p += group)
+	{
+		first = p * tileSize;
+		last = ((p + group) * tileSize < N) ? (p + group) * tileSize : N;
+
+		if (p > 0)
+		{
+			Ooc_Prefetch(0, oocBuffer[group]);
+		}
+
+		for (q = p; q < p + group && q < panels; q++)
+		{
+			Ooc_Transfer(q, oocBuffer[q - p], 0);
+			Ooc_Map(q, oocBuffer[q - p]);
+		}
+
+		for (q = 0; q < p; q++)
+		{
+			Ooc_Wait();
+			Ooc_Map(q, oocBuffer[group + q % 2]);
+
+			if (q + 1 < p)
+			{
+				Ooc_Prefetch(q + 1, oocBuffer[group + (q + 1) % 2]);
+			}
+
+			Fork_Join(ThreadOocWork, q * tileSize, (q + 1) * tileSize, first, last);
+		}
+
+		for (k = first; k < last - 1; k++)
+		{
+			Fork_Join(ThreadOocWork, k, k + 1, k + 1, last);
+		}
+
+		// b gets the steps of the group, y the normalized b of its pivots.
+		// Only the group's own rows depend on each other, the rows below get
+		// all of the group's steps at once on the worker threads.
+		for (k = first; k < last; k++)
+		{
+			y[k] = b[k] / oocColumn[k][k];
+
+			for (i = k + 1; i < last; i++)
+			{
+				b[i] = b[i] - oocColumn[k][i] * y[k];
+			}
+		}
+
+		if (last < N)
+		{
+			Fork_Join(ThreadOocRhsWork, first, last, last, N);
+		}
+
+		for (q = p; q < p + group && q < panels; q++)
+		{
+			Ooc_Transfer(q, oocBuffer[q - p], 1);
+		}
+	}
+}
+
+void* ThreadOocRhsWork(void* input)
+{
+	int i, k;
+	double *column;
+	ThreadData threadData = *(ThreadData*) input;
+
+	// Rows start..stop-1 of b get the steps k..kstop-1, in step order.
+	for (k = threadData.k; k < threadData.kstop; k++)
+	{
+		column = oocColumn[k];
+
+		for (i = threadData.start; i < threadData.stop; i++)
+		{
+			b[i] = b[i] - column[i] * y[k];
+		}
+	}
+
+	return NULL;
+}
+
+// Its own loop and not ThreadWork(): the panels hold columns, so the update
+// runs down a column (left-looking), where ThreadWork() runs along the rows
+// of an in-memory A (right-looking).
+void* ThreadOocWork(void* input)
+{
+	int i, j, k;
+	double *column, *pivot, multiplier;
+	ThreadData threadData = *(ThreadData*) input;
+	double start_time = MPI_Wtime();
+
+	// Columns start..stop-1 get the steps k..kstop-1. Column k holds the
+	// multipliers below the pivot, U is left above the diagonal.
+	for (j = threadData.start; j < threadData.stop; j++)
+	{
+		column = oocColumn[j];
+
+		for (k = threadData.k; k < threadData.kstop && k < j; k++)
+		{
+			pivot = oocColumn[k];
+
+			// Division step.
+			multiplier = column[k] / pivot[k];
+			column[k] = multiplier;
+
+			for (i = k + 1; i < N; i++)
+			{
+				// Elimination step.
+				column[i] = column[i] - pivot[i] * multiplier;
+			}
+		}
+	}
+
+	busyTime[threadData.id] += MPI_Wtime() - start_time;
+
+	return NULL;
+}
+
+void Back_Substitution_Out_Of_Core(void)
+{
+	int i, j, p, first, last;
+
+	for (i = 0; i < N; i++)
+	{
+		x[i] = y[i];
+	}
+
+	// Column oriented, panels from the right, the next one read meanwhile.
+	Ooc_Prefetch(panels - 1, oocBuffer[0]);
+
+	for (p = panels - 1; p >= 0; p--)
+	{
+		Ooc_Wait();
+		Ooc_Map(p, oocBuffer[(panels - 1 - p) % 2]);
+
+		if (p > 0)
+		{
+			Ooc_Prefetch(p - 1, oocBuffer[(panels - p) % 2]);
+		}
+
+		first = p * tileSize;
+		last = (first + tileSize < N) ? first + tileSize : N;
+
+		// The panel's own triangle, then the rows above it in parallel.
+		for (j = last - 1; j >= first; j--)
+		{
+			for (i = first; i < j; i++)
+			{
+				x[i] = x[i] - oocColumn[j][i] * x[j];
+			}
+		}
+
+		Fork_Join(ThreadOocBackWork, first, last, 0, first);
+	}
+}
+
+void* ThreadOocBackWork(void* input)
+{
+	int i, j;
+	ThreadData threadData = *(ThreadData*) input;
+
+	for (i = threadData.start; i < threadData.stop; i++)
+	{
+		for (j = threadData.kstop - 1; j >= threadData.k; j--)
+		{
+			x[i] = x[i] - oocColumn[j][i] * x[j];
+		}
+	}
+
+	return NULL;
+}
+
+void Ooc_Map(int p, double* buffer)
+{
+	int c;
+
+	for (c = p * tileSize; c < (p + 1) * tileSize && c < N; c++)
+	{
+		oocColumn[c] = buffer + (size_t)(c - p * tileSize) * N;
+	}
+}
+
+void Ooc_Prefetch(int p, double* buffer)
+{
+	oocPanel = p;
+	oocTarget = buffer;
+	pthread_create(&oocThread, NULL, Ooc_Read_Work, NULL);
+}
+
+void Ooc_Wait(void)
+{
+	double start_time = MPI_Wtime();
+
+	pthread_join(oocThread, NULL);
+	oocWaitTime += MPI_Wtime() - start_time;
+}
+
+void* Ooc_Read_Work(void* input)
+{
+	Ooc_Transfer(oocPanel, oocTarget, 0);
+
+	return NULL;
+}
+
+void Ooc_Transfer(int p, double* buffer, int write)
+{
+	int width = (N - p * tileSize < tileSize) ? N - p * tileSize : tileSize;
+	size_t bytes = (size_t)width * N * sizeof(double), done = 0;
+	off_t offset = (off_t)p * N * tileSize * sizeof(double);
+	ssize_t count;
+
+	// Large transfers can come back short, loop until the panel is done.
+	while (done < bytes)
+	{
+		count = write ? pwrite(oocFd, (char*)buffer + done, bytes - done, offset + done)
+			: pread(oocFd, (char*)buffer + done, bytes - done, offset + done);
+
+		if (count <= 0)
+		{
+			perror(OocFile);
+			exit(1);
+		}
+
+		done += count;
+	}
+
+	__atomic_add_fetch(write ? &oocWritten : &oocRead, (long long)bytes, __ATOMIC_RELAXED);
+}
+
+void Trace_Begin(void)
+{
+	int c;
+	struct perf_event_attr attr;
+	unsigned long long events[COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES };
+
+	traceSerial = calloc(N, sizeof(Interval));
+	traceStep = calloc(N, sizeof(Interval));
+	traceCompute = calloc((size_t)N * THREADS, sizeof(Interval));
+	traceCounters = calloc((size_t)(N + 1) * 2 * COUNTERS, sizeof(long long));
+
+	// The counters follow this thread and, with inherit, the threads it
+	// creates. A joined thread's counts are added to the parent's when it
+	// exits, so reading after the join covers the whole step.
+	for (c = 0; c < COUNTERS; c++)
+	{
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = events[c];
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		counterFd[c] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+		if (counterFd[c] < 0)
+		{
+			// No counters (perf_event_paranoid, container, VM), times only.
+			if (rank == 0)
+			{
+				perror("Trace: perf_event_open, hardware counters disabled");
+			}
+
+			while (c-- > 0)
+			{
+				close(counterFd[c]);
+			}
+
+			for (c = 0; c < COUNTERS; c++)
+			{
+				counterFd[c] = -1;
+			}
+
+			break;
+		}
+	}
+
+	traceOrigin = MPI_Wtime();
+}
+
+void Trace_Counters(long long* values)
+{
+	int c;
+
+	for (c = 0; c < COUNTERS; c++)
+	{
+		if (counterFd[c] < 0 || read(counterFd[c], &values[c], sizeof(long long)) != sizeof(long long))
+		{
+			values[c] = 0;
+		}
+	}
+}
+
+void Trace_End(void)
+{
+	int c, k, t;
+	double serial = 0.0, startup = 0.0, compute = 0.0, imbalance = 0.0, steps = 0.0;
+	long long counts[2][COUNTERS] = {{0}};
+	char name[256];
+	FILE *file;
+
+	// Counts of step k are the differences to the next reading.
+	for (k = 0; k < N; k++)
+	{
+		long long *now = &traceCounters[k * 2 * COUNTERS];
+		long long *next = &traceCounters[(k + 1) * 2 * COUNTERS];
+
+		for (c = 0; c < COUNTERS; c++)
+		{
+			counts[0][c] += now[COUNTERS + c] - now[c];
+			counts[1][c] += next[c] - now[COUNTERS + c];
+		}
+
+		serial += traceSerial[k].stop - traceSerial[k].start;
+		steps += traceStep[k].stop - traceStep[k].start;
+
+		// Per thread: fork to its first row, its row updates, and its last
+		// row to the join (waiting on the slowest thread).
+		for (t = 0; t < THREADS; t++)
+		{
+			Interval *run = &traceCompute[k * THREADS + t];
+
+			startup += (run->start - traceStep[k].start) / THREADS;
+			compute += (run->stop - run->start) / THREADS;
+			imbalance += (traceStep[k].stop - run->stop) / THREADS;
+		}
+	}
+
+	if (rank == 0)
+	{
+		printf("Trace (fork kernel, %d steps, %d threads, per thread average):\n", N, THREADS);
+		printf("  Serial division step%s: %f\n", ranks > 1 ? " and broadcast" : "", serial);
+		printf("  Threaded steps: %f\n", steps);
+		printf("    Thread start (fork to first row): %f\n", startup);
+		printf("    Row updates: %f\n", compute);
+		printf("    Load imbalance and join (last row to join): %f\n", imbalance);
+
+		if (counterFd[0] >= 0)
+		{
+			printf("  Serial: %lld cycles, %lld instructions, %lld LLC misses\n",
+				counts[0][0], counts[0][1], counts[0][2]);
+			printf("  Parallel: %lld cycles, %lld instructions (IPC %.2f), %lld LLC misses\n",
+				counts[1][0], counts[1][1], counts[1][0] > 0 ? (double)counts[1][1] / counts[1][0] : 0.0,
+				counts[1][2]);
+		}
+	}
+
+	// Chrome trace (chrome://tracing, Perfetto), one file per rank.
+	if (ranks > 1)
+	{
+		snprintf(name, sizeof(name), "%s.%d", TraceFile, rank);
+	}
+
+	else
+	{
+		snprintf(name, sizeof(name), "%s", TraceFile);
+	}
+
+	file = fopen(name, "w");
+
+	if (file == NULL)
+	{
+		perror(name);
+	}
+
+	else
+	{
+		fprintf(file, "{\"traceEvents\":[\n");
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"main\"}}", rank);
+
+		for (t = 0; t < THREADS; t++)
+		{
+			fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+				rank, t + 1, t);
+		}
+
+		for (k = 0; k < N; k++)
+		{
+			fprintf(file, ",\n{\"name\":\"division\",\"ph\":\"X\",\"pid\":%d,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"k\":%d}}",
+				rank, 1e6 * traceSerial[k].start, 1e6 * (traceSerial[k].stop - traceSerial[k].start), k);
+			fprintf(file, ",\n{\"name\":\"step\",\"ph\":\"X\",\"pid\":%d,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"k\":%d}}",
+				rank, 1e6 * traceStep[k].start, 1e6 * (traceStep[k].stop - traceStep[k].start), k);
+
+			for (t = 0; t < THREADS; t++)
+			{
+				Interval *run = &traceCompute[k * THREADS + t];
+
+				fprintf(file, ",\n{\"name\":\"update\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"k\":%d}}",
+					rank, t + 1, 1e6 * run->start, 1e6 * (run->stop - run->start), k);
+			}
+
+			if (counterFd[0] >= 0)
+			{
+				long long *now = &traceCounters[k * 2 * COUNTERS];
+				long long *next = &traceCounters[(k + 1) * 2 * COUNTERS];
+
+				fprintf(file, ",\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":%d,\"ts\":%.3f,\"args\":{\"cycles\":%lld,\"instructions\":%lld,\"llc_misses\":%lld}}",
+					rank, 1e6 * traceSerial[k].start, next[0] - now[0], next[1] - now[1], next[2] - now[2]);
+			}
+		}
+
+		fprintf(file, "\n]}\n");
+		fclose(file);
+	}
+
+	for (c = 0; c < COUNTERS; c++)
+	{
+		if (counterFd[c] >= 0)
+		{
+			close(counterFd[c]);
+		}
+	}
+
+	free(traceSerial);
+	free(traceStep);
+	free(traceCompute);
+	free(traceCounters);
+	traceSerial = NULL;
+}
+
+void Setup_Threads(void)
+{
+	int i, cpu, count = 0, *cpus;
+	cpu_set_t allowed, set;
+
+	if (THREADS <= 0)
+	{
+		THREADS = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+
+	thread = malloc(THREADS * sizeof(pthread_t));
+	threadAttr = malloc(THREADS * sizeof(pthread_attr_t));
+	threadData = malloc(THREADS * sizeof(ThreadData));
+	deques = malloc(THREADS * sizeof(Deque));
+	busyTime = malloc(THREADS * sizeof(double));
+	verifyNorms = malloc(THREADS * sizeof(*verifyNorms));
+
+	for(i = 0; i < THREADS; i++)
+	{
+		threadData[i].id = i;
+		threadData[i].k = 0;
+		threadData[i].start = 0;
+		threadData[i].stop = 0;
+		threadData[i].kstop = 0;
+		busyTime[i] = 0.0;
+		pthread_attr_init(&threadAttr[i]);
+	}
+
+	if (strcmp(Pinning, "none") == 0)
+	{
+		return;
+	}
+
+	// CPUs this process may run on, ordered for the placement.
+	cpus = malloc(CPU_SETSIZE * sizeof(int));
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+	{
+		CPU_ZERO(&allowed);
+	}
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	{
+		if (!CPU_ISSET(cpu, &allowed))
+		{
+			continue;
+		}
+
+		// The first CPU of a core's sibling list is its primary thread.
+		if (SMT == 0 && Read_Topology(cpu, "thread_siblings_list") != cpu)
+		{
+			continue;
+		}
+
+		cpus[count++] = cpu;
+	}
+
+	if (count == 0)
+	{
+		// Empty affinity mask, or -S/-p left no CPU to place threads on.
+		printf("No CPU left for pinning %s, threads are not pinned.\n", Pinning);
+		free(cpus);
+		return;
+	}
+
+	qsort(cpus, count, sizeof(int), Compare_CPUs);
+
+	// Ranks on the same box take consecutive groups of CPUs.
+	for (i = 0; i < THREADS; i++)
+	{
+		CPU_ZERO(&set);
+		CPU_SET(cpus[(rank * THREADS + i) % count], &set);
+		pthread_attr_setaffinity_np(&threadAttr[i], sizeof(set), &set);
+	}
+
+	free(cpus);
+}
+
+int Read_Topology(int cpu, char* name)
+{
+	char path[128];
+	int value = -1;
+	FILE *file;
+
+	// First number of /sys/devices/system/cpu/cpuN/topology/name, -1 if unknown.
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+	file = fopen(path, "r");
+
+	if (file != NULL)
+	{
+		if (fscanf(file, "%d", &value) != 1)
+		{
+			value = -1;
+		}
+
+		fclose(file);
+	}
+
+	return value;
+}
+
+int Compare_CPUs(const void* left, const void* right)
+{
+	int a = *(const int*) left, b = *(const int*) right;
+	int keyA[3], keyB[3], i;
+
+	// Compact: package, core, then SMT sibling, so a core's siblings are
+	// adjacent. Scatter: SMT sibling, core, then package, so consecutive
+	// threads land on different packages and cores first.
+	keyA[0] = Read_Topology(a, "physical_package_id");
+	keyA[1] = Read_Topology(a, "core_id");
+	keyA[2] = (Read_Topology(a, "thread_siblings_list") == a) ? 0 : 1;
+	keyB[0] = Read_Topology(b, "physical_package_id");
+	keyB[1] = Read_Topology(b, "core_id");
+	keyB[2] = (Read_Topology(b, "thread_siblings_list") == b) ? 0 : 1;
+
+	if (strcmp(Pinning, "scatter") == 0)
+	{
+		for (i = 2; i >= 0; i--)
+		{
+			if (keyA[i] != keyB[i])
+			{
+				return keyA[i] - keyB[i];
+			}
+		}
+	}
+
+	else
+	{
+		for (i = 0; i < 3; i++)
+		{
+			if (keyA[i] != keyB[i])
+			{
+				return keyA[i] - keyB[i];
+			}
+		}
+	}
+
+	return a - b;
+}
+
+void Fork_Join(void* (*work)(void*), int k, int kstop, int first, int last)
+{
+	int i, offset;
+
+	// Calculate offset
+	offset = (last - first) / THREADS;
+
+	// Split rows first..last over the threads.
+	for(i = 0; i < (THREADS - 1); i++)
+	{
+		// Set data and create the thread.
+		threadData[i].k = k;
+		threadData[i].kstop = kstop;
+		threadData[i].start	= first + (offset * i);
+		threadData[i].stop	= first + (offset * (i + 1));
+		pthread_create(&thread[i], &threadAttr[i], work, (void*)&threadData[i]);
+	}
+
+	// Set data, and create last thread.
+	threadData[(THREADS - 1)].k = k;
+	threadData[(THREADS - 1)].kstop = kstop;
+	threadData[(THREADS - 1)].start	= first + (offset * (THREADS - 1));
+	threadData[(THREADS - 1)].stop	= last;
+	pthread_create(&thread[THREADS - 1], &threadAttr[THREADS - 1], work, (void*)&threadData[(THREADS - 1)]);
+
+	// Wait for all threads to terminate.
+	for (i = 0; i < THREADS; i++)
+	{
+		pthread_join(thread[i], NULL);
+	}
+}
+
+void Fork_Join_Owned(void* (*work)(void*), int k, int first, int last)
+{
+	int i, block = first / CHUNK, next;
+
+	// Rows are dealt out in blocks of CHUNK, thread t always gets the blocks
+	// with block % THREADS == t, so a row stays with the same (pinned)
+	// thread and its cache across pivot steps. start is the first row of
+	// thread i at or after first.
+	for (i = 0; i < THREADS; i++)
+	{
+		next = ((i - block) % THREADS + THREADS) % THREADS;
+		threadData[i].k = k;
+		threadData[i].kstop = THREADS;
+		threadData[i].start = (next == 0) ? first : (block + next) * CHUNK;
+		threadData[i].stop = last;
+		pthread_create(&thread[i], &threadAttr[i], work, (void*)&threadData[i]);
+	}
+
+	// Wait for all threads to terminate.
+	for (i = 0; i < THREADS; i++)
+	{
+		pthread_join(thread[i], NULL);
+	}
+}
+
+int Next_Owned_Row(int i)
+{
+	// The next row of the same thread, in the same block or THREADS - 1
+	// blocks on.
+	return ((i + 1) % CHUNK != 0) ? i + 1 : i + 1 + (THREADS - 1) * CHUNK;
+}
+
+void* ThreadWork(void* input)
+{
+	int i, j;
+	ThreadData threadData = *(ThreadData*) input;
+	double start_time = MPI_Wtime();
+	double stop_time;
+		
+	// Owned rows from start below stop.
+	for (i = threadData.start; i < threadData.stop; i = Next_Owned_Row(i))
+	{
+		for (j = threadData.k+1; j < N; j++)
+		{
+			// Elimination step.
+			A[i][j] = A[i][j] - A[i][threadData.k] * pivotRow[j]; 
+		}
+
+		b[i] = b[i] - A[i][threadData.k] * pivotY;
+
+		if (KEEP_L == 0)
+		{
+			A[i][threadData.k] = 0.0;
+		}
+	}
+
+	stop_time = MPI_Wtime();
+	busyTime[threadData.id] += stop_time - start_time;
+
+	if (traceCompute != NULL)
+	{
+		traceCompute[threadData.k * THREADS + threadData.id].start = start_time - traceOrigin;
+		traceCompute[threadData.k * THREADS + threadData.id].stop = stop_time - traceOrigin;
+	}
+
+	return NULL;
+}
+
+void Work_Pipelined(void)
+{
+	int i;
+
+	// Same elimination as Work(), but without a join per pivot. Thread t owns
+	// rows t, t + THREADS, ... and applies step k to them as soon as row k is
+	// published. The owner of row k + 1 updates and normalizes it first, so
+	// the next pivot is ready while the other rows of step k are still being
+	// updated.
+	ready = calloc(N, sizeof(int));
+
+	for (i = 0; i < THREADS; i++)
+	{
+		threadData[i].k = 0;
+		threadData[i].start = i;
+		threadData[i].stop = N;
+		pthread_create(&thread[i], &threadAttr[i], ThreadPipeWork, (void*)&threadData[i]);
+	}
+
+	// Wait for all threads to terminate.
+	for (i = 0; i < THREADS; i++)
+	{
+		pthread_join(thread[i], NULL);
+	}
+
+	free(ready);
+}
+
+void* ThreadPipeWork(void* input)
+{
+	int i, j, k, spins;
+	ThreadData threadData = *(ThreadData*) input;
+	double start_time, wait_time = 0.0, wait_start;
+
+	start_time = MPI_Wtime();
+
+	// Rows start, start + THREADS, ... belong to this thread.
+	if (threadData.start == 0)
+	{
+		Normalize_Row(0);
+		__atomic_store_n(&ready[0], 1, __ATOMIC_RELEASE);
+	}
+
+	for (k = 0; k < N - 1; k++)
+	{
+		// Wait for pivot row k.
+		spins = 0;
+
+		if (__atomic_load_n(&ready[k], __ATOMIC_ACQUIRE) == 0)
+		{
+			wait_start = MPI_Wtime();
+
+			while (__atomic_load_n(&ready[k], __ATOMIC_ACQUIRE) == 0)
+			{
+				if (++spins > SPIN_LIMIT)
+				{
+					sched_yield();
+				}
+			}
+
+			wait_time += MPI_Wtime() - wait_start;
+		}
+
+		// First local row below the pivot.
+		i = k + 1 + ((threadData.start - (k + 1)) % THREADS + THREADS) % THREADS;
+
+		for (; i < threadData.stop; i += THREADS)
+		{
+			for (j = k+1; j < N; j++)
+			{
+				// Elimination step.
+				A[i][j] = A[i][j] - A[i][k] * A[k][j];
+			}
+
+			b[i] = b[i] - A[i][k] * y[k];
+
+			if (KEEP_L == 0)
+			{
+				A[i][k] = 0.0;
+			}
+
+			// Lookahead, publish the next pivot before the rest of step k.
+			if (i == k + 1)
+			{
+				Normalize_Row(i);
+				__atomic_store_n(&ready[i], 1, __ATOMIC_RELEASE);
+			}
+		}
+	}
+
+	busyTime[threadData.id] = MPI_Wtime() - start_time - wait_time;
+
+	return NULL;
+}
+
+void Normalize_Row(int k)
+{
+	int j;
+
+	for (j = k+1; j < N; j++)
+	{
+		// Division step.
+		A[k][j] = A[k][j] / A[k][k];
+	}
+
+	y[k] = b[k] / A[k][k];
+
+	if (KEEP_L == 0)
+	{
+		A[k][k] = 1.0;
+	}
+}
+
+void Work_Tiled(void)
+{
+	int i, j, k, sum;
+
+	// Tiled LU on tileSize x tileSize tiles, run as a task graph by one
+	// worker per thread with work stealing. A = L U where L keeps the pivots
+	// on its diagonal and U has a unit diagonal, the same factors Work()
+	// produces, so updates from different pivot steps can overlap.
+	while ((N + tileSize - 1) / tileSize > MAX_TILES)
+	{
+		tileSize *= 2;
+	}
+
+	tiles = (N + tileSize - 1) / tileSize;
+	taskDeps = malloc((size_t)tiles * tiles * tiles * sizeof(int));
+	tasksDone = 0;
+	tasksTotal = 0;
+
+	for (i = 0; i < tiles; i++)
+	{
+		for (j = 0; j < tiles; j++)
+		{
+			for (k = 0; k <= i && k <= j; k++)
+			{
+				// The previous task on the same tile.
+				sum = (k > 0) ? 1 : 0;
+
+				if (k == i && k == j)
+				{
+					// Diagonal factorization.
+				}
+
+				else if (k == i || k == j)
+				{
+					// Row or column solve, needs the diagonal tile.
+					sum += 1;
+				}
+
+				else
+				{
+					// Update, needs the row and column solves of step k.
+					sum += 2;
+				}
+
+				taskDeps[Tile_Task(i, j, k)] = sum;
+				tasksTotal++;
+			}
+		}
+	}
+
+	for (i = 0; i < THREADS; i++)
+	{
+		deques[i].capacity = 64;
+		deques[i].tasks = malloc(deques[i].capacity * sizeof(int));
+		deques[i].top = 0;
+		deques[i].bottom = 0;
+		pthread_mutex_init(&deques[i].lock, NULL);
+	}
+
+	Deque_Push(&deques[0], Tile_Task(0, 0, 0));
+
+	for (i = 0; i < THREADS; i++)
+	{
+		pthread_create(&thread[i], &threadAttr[i], ThreadTileWork, (void*)&threadData[i]);
+	}
+
+	// Wait for all threads to terminate.
+	for (i = 0; i < THREADS; i++)
+	{
+		pthread_join(thread[i], NULL);
+	}
+
+	for (i = 0; i < THREADS; i++)
+	{
+		free(deques[i].tasks);
+		pthread_mutex_destroy(&deques[i].lock);
+	}
+
+	free(taskDeps);
+
+	Finish_Factors();
+}
+
+void Finish_Factors(void)
+{
+	int i, j;
+
+	// Forward substitution L y = b, then leave A as the unit upper U unless
+	// the factors are kept. b ends up as the reduced right hand side, as in
+	// Work().
+	for (i = 0; i < N; i++)
+	{
+		for (j = 0; j < i; j++)
+		{
+			b[i] = b[i] - A[i][j] * y[j];
+		}
+
+		y[i] = b[i] / A[i][i];
+
+		if (KEEP_L == 0)
+		{
+			for (j = 0; j < i; j++)
+			{
+				A[i][j] = 0.0;
+			}
+
+			A[i][i] = 1.0;
+		}
+	}
+}
+
+void Work_Recursive(void)
+{
+	// Cache-oblivious LU, the column range is halved recursively so every
+	// level works on blocks that fit some level of the cache without a
+	// tuned block size. Same factors as Work_Tiled().
+	Rec_LU(0, N);
+	Finish_Factors();
+}
+
+void Rec_LU(int c0, int c1)
+{
+	int m, p, r, c;
+	double l;
+
+	// Factor rows c0..N-1 of columns c0..c1-1, updated up to column c0.
+	if (c1 - c0 <= REC_BASE)
+	{
+		for (p = c0; p < c1; p++)
+		{
+			for (c = p + 1; c < c1; c++)
+			{
+				A[p][c] = A[p][c] / A[p][p];
+			}
+
+			for (r = p + 1; r < N; r++)
+			{
+				l = A[r][p];
+
+				for (c = p + 1; c < c1; c++)
+				{
+					A[r][c] = A[r][c] - l * A[p][c];
+				}
+			}
+		}
+
+		return;
+	}
+
+	m = (c0 + c1) / 2;
+
+	// Left half.
+	Rec_LU(c0, m);
+
+	// U12 = L11^-1 A12, split over the columns when it is large.
+	recInner0 = c0;
+	recInner1 = m;
+
+	if ((double)(m - c0) * (m - c0) * (c1 - m) > REC_PARALLEL)
+	{
+		Fork_Join(ThreadRecTrsmWork, 0, 0, m, c1);
+	}
+
+	else
+	{
+		threadData[0].start = m;
+		threadData[0].stop = c1;
+		ThreadRecTrsmWork((void*)&threadData[0]);
+	}
+
+	// A22 -= L21 U12, split over the rows when it is large.
+	recColumn0 = m;
+	recColumn1 = c1;
+
+	if ((double)(N - m) * (m - c0) * (c1 - m) > REC_PARALLEL)
+	{
+		Fork_Join(ThreadRecGemmWork, 0, 0, m, N);
+	}
+
+	else
+	{
+		Rec_Gemm(m, N, m, c1, c0, m);
+	}
+
+	// Right half.
+	Rec_LU(m, c1);
+}
+
+void Rec_Gemm(int r0, int r1, int c0, int c1, int k0, int k1)
+{
+	int r, c, p;
+	double l;
+
+	// A(r0..r1, c0..c1) -= A(r0..r1, k0..k1) A(k0..k1, c0..c1), halving the
+	// largest dimension until the blocks are small.
+	if (r1 - r0 > REC_GEMM_BASE && r1 - r0 >= c1 - c0 && r1 - r0 >= k1 - k0)
+	{
+		Rec_Gemm(r0, (r0 + r1) / 2, c0, c1, k0, k1);
+		Rec_Gemm((r0 + r1) / 2, r1, c0, c1, k0, k1);
+	}
+
+	else if (c1 - c0 > REC_GEMM_BASE && c1 - c0 >= k1 - k0)
+	{
+		Rec_Gemm(r0, r1, c0, (c0 + c1) / 2, k0, k1);
+		Rec_Gemm(r0, r1, (c0 + c1) / 2, c1, k0, k1);
+	}
+
+	else if (k1 - k0 > REC_GEMM_BASE)
+	{
+		Rec_Gemm(r0, r1, c0, c1, k0, (k0 + k1) / 2);
+		Rec_Gemm(r0, r1, c0, c1, (k0 + k1) / 2, k1);
+	}
+
+	else
+	{
+		for (r = r0; r < r1; r++)
+		{
+			for (p = k0; p < k1; p++)
+			{
+				l = A[r][p];
+
+				for (c = c0; c < c1; c++)
+				{
+					A[r][c] = A[r][c] - l * A[p][c];
+				}
+			}
+		}
+	}
+}
+
+void* ThreadRecGemmWork(void* input)
+{
+	ThreadData threadData = *(ThreadData*) input;
+	double start_time = MPI_Wtime();
+
+	Rec_Gemm(threadData.start, threadData.stop, recColumn0, recColumn1, recInner0, recInner1);
+	busyTime[threadData.id] += MPI_Wtime() - start_time;
+
+	return NULL;
+}
+
+void* ThreadRecTrsmWork(void* input)
+{
+	int p, q, c;
+	double l;
+	ThreadData threadData = *(ThreadData*) input;
+
+	// Columns start..stop of rows recInner0..recInner1, forward solve with
+	// the lower triangle (pivots on the diagonal).
+	for (p = recInner0; p < recInner1; p++)
+	{
+		for (q = recInner0; q < p; q++)
+		{
+			l = A[p][q];
+
+			for (c = threadData.start; c < threadData.stop; c++)
+			{
+				A[p][c] = A[p][c] - l * A[q][c];
+			}
+		}
+
+		for (c = threadData.start; c < threadData.stop; c++)
+		{
+			A[p][c] = A[p][c] / A[p][p];
+		}
+	}
+
+	return NULL;
+}
+
+void* ThreadTileWork(void* input)
+{
+	int id, v, spins = 0;
+	int me = ((ThreadData*) input)->id;
+	double start_time;
+
+	while (__atomic_load_n(&tasksDone, __ATOMIC_ACQUIRE) < tasksTotal)
+	{
+		id = Deque_Pop(&deques[me]);
+
+		// Own deque empty, steal the oldest task of another worker.
+		for (v = 1; id < 0 && v < THREADS; v++)
+		{
+			id = Deque_Steal(&deques[(me + v) % THREADS]);
+		}
+
+		if (id < 0)
+		{
+			if (++spins > SPIN_LIMIT)
+			{
+				sched_yield();
+			}
+
+			continue;
+		}
+
+		spins = 0;
+		start_time = MPI_Wtime();
+		Tile_Run(id);
+		busyTime[me] += MPI_Wtime() - start_time;
+
+		Tile_Release(me, id);
+		__atomic_add_fetch(&tasksDone, 1, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+int Tile_Task(int i, int j, int k)
+{
+	return (i * tiles + j) * tiles + k;
+}
+
+void Tile_Run(int id)
+{
+	int r, c, p, q;
+	double l;
+	int k = id % tiles;
+	int j = (id / tiles) % tiles;
+	int i = id / (tiles * tiles);
+
+	int r0 = i * tileSize, r1 = (r0 + tileSize < N) ? r0 + tileSize : N;
+	int c0 = j * tileSize, c1 = (c0 + tileSize < N) ? c0 + tileSize : N;
+	int k0 = k * tileSize, k1 = (k0 + tileSize < N) ? k0 + tileSize : N;
+
+	if (k == i && k == j)
+	{
+		// Factor the diagonal tile, the elimination of Work() on one tile.
+		for (p = k0; p < k1; p++)
+		{
+			for (c = p + 1; c < k1; c++)
+			{
+				A[p][c] = A[p][c] / A[p][p];
+			}
+
+			for (r = p + 1; r < k1; r++)
+			{
+				for (c = p + 1; c < k1; c++)
+				{
+					A[r][c] = A[r][c] - A[r][p] * A[p][c];
+				}
+			}
+		}
+	}
+
+	else if (k == i)
+	{
+		// U(k, j) = L(k, k)^-1 A(k, j).
+		for (p = k0; p < k1; p++)
+		{
+			for (q = k0; q < p; q++)
+			{
+				l = A[p][q];
+
+				for (c = c0; c < c1; c++)
+				{
+					A[p][c] = A[p][c] - l * A[q][c];
+				}
+			}
+
+			for (c = c0; c < c1; c++)
+			{
+				A[p][c] = A[p][c] / A[p][p];
+			}
+		}
+	}
+
+	else if (k == j)
+	{
+		// L(i, k) = A(i, k) U(k, k)^-1.
+		for (r = r0; r < r1; r++)
+		{
+			for (p = k0; p < k1; p++)
+			{
+				l = A[r][p];
+
+				for (c = p + 1; c < k1; c++)
+				{
+					A[r][c] = A[r][c] - l * A[p][c];
+				}
+			}
+		}
+	}
+
+	else
+	{
+		// A(i, j) -= L(i, k) U(k, j).
+		for (r = r0; r < r1; r++)
+		{
+			for (p = k0; p < k1; p++)
+			{
+				l = A[r][p];
+
+				for (c = c0; c < c1; c++)
+				{
+					A[r][c] = A[r][c] - l * A[p][c];
+				}
+			}
+		}
+	}
+}
+
+void Tile_Release(int me, int id)
+{
+	int t;
+	int k = id % tiles;
+	int j = (id / tiles) % tiles;
+	int i = id / (tiles * tiles);
+
+	// Decrement the successors, the last predecessor pushes the task.
+	#define RELEASE(task) \
+		if (__atomic_sub_fetch(&taskDeps[task], 1, __ATOMIC_ACQ_REL) == 0) \
+		{ \
+			Deque_Push(&deques[me], task); \
+		}
+
+	if (k < i && k < j)
+	{
+		RELEASE(Tile_Task(i, j, k + 1));
+	}
+
+	else if (k == i && k == j)
+	{
+		for (t = k + 1; t < tiles; t++)
+		{
+			RELEASE(Tile_Task(k, t, k));
+			RELEASE(Tile_Task(t, k, k));
+		}
+	}
+
+	else if (k == i)
+	{
+		for (t = k + 1; t < tiles; t++)
+		{
+			RELEASE(Tile_Task(t, j, k));
+		}
+	}
+
+	else
+	{
+		for (t = k + 1; t < tiles; t++)
+		{
+			RELEASE(Tile_Task(i, t, k));
+		}
+	}
+
+	#undef RELEASE
+}
+
+void Deque_Push(Deque* deque, int task)
+{
+	int i, *tasks;
+
+	pthread_mutex_lock(&deque->lock);
+
+	if (deque->bottom - deque->top == deque->capacity)
+	{
+		// Full, grow and unwrap the ring.
+		tasks = malloc(2 * deque->capacity * sizeof(int));
+
+		for (i = deque->top; i < deque->bottom; i++)
+		{
+			tasks[i - deque->top] = deque->tasks[i % deque->capacity];
+		}
+
+		free(deque->tasks);
+		deque->tasks = tasks;
+		deque->bottom -= deque->top;
+		deque->top = 0;
+		deque->capacity *= 2;
+	}
+
+	deque->tasks[deque->bottom % deque->capacity] = task;
+	deque->bottom++;
+
+	pthread_mutex_unlock(&deque->lock);
+}
+
+int Deque_Pop(Deque* deque)
+{
+	int task = -1;
+
+	pthread_mutex_lock(&deque->lock);
+
+	if (deque->bottom > deque->top)
+	{
+		deque->bottom--;
+		task = deque->tasks[deque->bottom % deque->capacity];
+	}
+
+	pthread_mutex_unlock(&deque->lock);
+
+	return task;
+}
+
+int Deque_Steal(Deque* deque)
+{
+	int task = -1;
+
+	pthread_mutex_lock(&deque->lock);
+
+	if (deque->bottom > deque->top)
+	{
+		task = deque->tasks[deque->top % deque->capacity];
+		deque->top++;
+	}
+
+	pthread_mutex_unlock(&deque->lock);
+
+	return task;
+}
+
+void Work_Band(void)
+{
+	int i, j;
+
+	// Dense input, detect the bandwidths that were not given and pack A.
+	if (AB == NULL)
+	{
+		int kl = 0, ku = 0;
+
+		for (i = 0; i < N; i++)
+		{
+			for (j = 0; j < N; j++)
+			{
+				if (A[i][j] != 0.0)
+				{
+					kl = (i - j > kl) ? i - j : kl;
+					ku = (j - i > ku) ? j - i : ku;
+				}
+			}
+		}
+
+		KL = (KL < 0) ? kl : KL;
+		KU = (KU < 0) ? ku : KU;
+		Allocate_Band();
+
+		for (i = 0; i < N; i++)
+		{
+			for (j = i - KL; j <= i + KU; j++)
+			{
+				if (j >= 0 && j < N)
+				{
+					AB[i][j - i + KL] = A[i][j];
+				}
+			}
+		}
+	}
+
+	pthread_barrier_init(&bandBarrier, NULL, THREADS);
+
+	for (i = 0; i < THREADS; i++)
+	{
+		pthread_create(&thread[i], &threadAttr[i], ThreadBandWork, (void*)&threadData[i]);
+	}
+
+	// Wait for all threads to terminate.
+	for (i = 0; i < THREADS; i++)
+	{
+		pthread_join(thread[i], NULL);
+	}
+
+	pthread_barrier_destroy(&bandBarrier);
+}
+
+void* ThreadBandWork(void* input)
+{
+	int i, j, k, last, bottom, first, stop;
+	double pivot, l;
+	int id = ((ThreadData*) input)->id;
+	double start_time, wait_time = 0.0, wait_start;
+
+	start_time = MPI_Wtime();
+
+	// Each thread owns a slice of the columns k+1..k+KU in every step, it
+	// divides its part of the pivot row and updates the same columns of all
+	// rows in the band, so one barrier per step is enough. Thread 0 also
+	// handles b and y, and clears step k's multipliers after the barrier,
+	// which touches no column step k+1 uses. O(N * KL * KU) in total.
+	for (k = 0; k < N; k++)
+	{
+		last = (k + KU < N - 1) ? k + KU : N - 1;
+		bottom = (k + KL < N - 1) ? k + KL : N - 1;
+		pivot = AB[k][KL];
+
+		first = k + 1 + ((last - k) * id) / THREADS;
+		stop = k + 1 + ((last - k) * (id + 1)) / THREADS;
+
+		for (j = first; j < stop; j++)
+		{
+			// Division step.
+			AB[k][j - k + KL] = AB[k][j - k + KL] / pivot;
+		}
+
+		for (i = k + 1; i <= bottom; i++)
+		{
+			l = AB[i][k - i + KL];
+
+			for (j = first; j < stop; j++)
+			{
+				// Elimination step.
+				AB[i][j - i + KL] = AB[i][j - i + KL] - l * AB[k][j - k + KL];
+			}
+		}
+
+		if (id == 0)
+		{
+			y[k] = b[k] / pivot;
+
+			for (i = k + 1; i <= bottom; i++)
+			{
+				b[i] = b[i] - AB[i][k - i + KL] * y[k];
+			}
+		}
+
+		wait_start = MPI_Wtime();
+		pthread_barrier_wait(&bandBarrier);
+		wait_time += MPI_Wtime() - wait_start;
+
+		if (id == 0 && KEEP_L == 0)
+		{
+			AB[k][KL] = 1.0;
+
+			for (i = k + 1; i <= bottom; i++)
+			{
+				AB[i][k - i + KL] = 0.0;
+			}
+		}
+	}
+
+	busyTime[id] = MPI_Wtime() - start_time - wait_time;
+
+	return NULL;
+}
+
+void Allocate_Sparse(void)
+{
+	int i, g, count;
+
+	if (SparseFile != NULL)
+	{
+		// N and the pattern come from the file.
+		Read_Sparse();
+		return;
+	}
+
+	// Five point stencil on a g x g grid, unknown i at (i / g, i % g). The
+	// columns and values are filled by ThreadInitWork().
+	g = 1;
+
+	while (g * g < N)
+	{
+		g++;
+	}
+
+	spRowPtr = malloc((N + 1) * sizeof(int));
+	spRowPtr[0] = 0;
+
+	for (i = 0; i < N; i++)
+	{
+		count = 1 + (i - g >= 0) + (i % g > 0) + (i % g < g - 1 && i + 1 < N) + (i + g < N);
+		spRowPtr[i + 1] = spRowPtr[i] + count;
+	}
+
+	spNnz = spRowPtr[N];
+	spCol = malloc((spNnz > 0 ? spNnz : 1) * sizeof(int));
+	spValue = malloc((spNnz > 0 ? spNnz : 1) * sizeof(double));
+	spGrid = g;
+}
+
+void Read_Sparse(void)
+{
+	char line[256];
+	int i, j, n, m, e, entries, symmetric, skew, pattern, *count;
+	int *rowOf, *colOf;
+	double value, *valueOf;
+	FILE *file = fopen(SparseFile, "r");
+
+	// Matrix Market coordinate format, 1-based "i j value" entries, or
+	// "i j" in a pattern file where every entry is 1.0.
+	if (file == NULL || fgets(line, sizeof(line), file) == NULL || strstr(line, "coordinate") == NULL)
+	{
+		printf("%s is not a Matrix Market coordinate file.\n", SparseFile);
+		exit(1);
+	}
+
+	if (strstr(line, "complex") != NULL || strstr(line, "hermitian") != NULL)
+	{
+		printf("%s: complex matrices are not supported.\n", SparseFile);
+		exit(1);
+	}
+
+	symmetric = (strstr(line, "symmetric") != NULL);
+	skew = (strstr(line, "skew-symmetric") != NULL);
+	pattern = (strstr(line, "pattern") != NULL);
+
+	do
+	{
+		if (fgets(line, sizeof(line), file) == NULL)
+		{
+			printf("%s has no size line.\n", SparseFile);
+			exit(1);
+		}
+	} while (line[0] == '%');
+
+	if (sscanf(line, "%d %d %d", &n, &m, &entries) != 3 || n != m || n < 1)
+	{
+		printf("%s is not a square matrix.\n", SparseFile);
+		exit(1);
+	}
+
+	// Symmetric files store the lower triangle, mirror the off-diagonal
+	// entries, negated for a skew-symmetric file.
+	rowOf = malloc(2 * (size_t)entries * sizeof(int));
+	colOf = malloc(2 * (size_t)entries * sizeof(int));
+	valueOf = malloc(2 * (size_t)entries * sizeof(double));
+	m = 0;
+
+	for (e = 0; e < entries; e++)
+	{
+		value = 1.0;
+
+		if ((pattern ? fscanf(file, "%d %d", &i, &j) != 2 : fscanf(file, "%d %d %lf", &i, &j, &value) != 3) ||
+			i < 1 || i > n || j < 1 || j > n)
+		{
+			printf("%s: bad entry %d.\n", SparseFile, e + 1);
+			exit(1);
+		}
+
+		rowOf[m] = i - 1;
+		colOf[m] = j - 1;
+		valueOf[m++] = value;
+
+		if (symmetric && i != j)
+		{
+			rowOf[m] = j - 1;
+			colOf[m] = i - 1;
+			valueOf[m++] = skew ? -value : value;
+		}
+	}
+
+	fclose(file);
+
+	// Bucket the entries by row.
+	N = n;
+	spNnz = m;
+	spRowPtr = calloc(N + 1, sizeof(int));
+	spCol = malloc((m > 0 ? m : 1) * sizeof(int));
+	spValue = malloc((m > 0 ? m : 1) * sizeof(double));
+	count = malloc(N * sizeof(int));
+
+	for (e = 0; e < m; e++)
+	{
+		spRowPtr[rowOf[e] + 1]++;
+	}
+
+	for (i = 0; i < N; i++)
+	{
+		spRowPtr[i + 1] += spRowPtr[i];
+		count[i] = spRowPtr[i];
+	}
+
+	for (e = 0; e < m; e++)
+	{
+		spCol[count[rowOf[e]]] = colOf[e];
+		spValue[count[rowOf[e]]++] = valueOf[e];
+	}
+
+	free(count);
+	free(rowOf);
+	free(colOf);
+	free(valueOf);
+}
+
+void Work_Sparse(void)
+{
+	int i, j, e;
+	double start_time = MPI_Wtime();
+
+	if (spRowPtr == NULL)
+	{
+		// Dense input, keep its nonzeros. A is not used after this.
+		spRowPtr = malloc((N + 1) * sizeof(int));
+		spRowPtr[0] = 0;
+
+		for (i = 0; i < N; i++)
+		{
+			for (j = 0, e = 0; j < N; j++)
+			{
+				e += (A[i][j] != 0.0);
+			}
+
+			spRowPtr[i + 1] = spRowPtr[i] + e;
+		}
+
+		spNnz = spRowPtr[N];
+		spCol = malloc((spNnz > 0 ? spNnz : 1) * sizeof(int));
+		spValue = malloc((spNnz > 0 ? spNnz : 1) * sizeof(double));
+
+		for (i = 0, e = 0; i < N; i++)
+		{
+			for (j = 0; j < N; j++)
+			{
+				if (A[i][j] != 0.0)
+				{
+					spCol[e] = j;
+					spValue[e++] = A[i][j];
+				}
+			}
+		}
+	}
+
+	Sparse_Order();
+	spOrderTime = MPI_Wtime() - start_time;
+
+	start_time = MPI_Wtime();
+	Sparse_Symbolic();
+	spSymbolicTime = MPI_Wtime() - start_time;
+
+	// Numeric factorization, a column is ready once all its children in the
+	// elimination tree are done. The leaves start ready.
+	start_time = MPI_Wtime();
+	spHead = spTail = spDone = 0;
+
+	for (j = 0; j < N; j++)
+	{
+		if (spPending[j] == 0)
+		{
+			spQueue[spTail++] = j;
+		}
+	}
+
+	for (i = 0; i < THREADS; i++)
+	{
+		pthread_create(&thread[i], &threadAttr[i], ThreadSparseWork, (void*)&threadData[i]);
+	}
+
+	for (i = 0; i < THREADS; i++)
+	{
+		pthread_join(thread[i], NULL);
+	}
+
+	// Forward substitution L y = b in the new order, y[j] belongs to
+	// unknown spPerm[j].
+	for (j = 0; j < N; j++)
+	{
+		y[j] = b[spPerm[j]];
+	}
+
+	for (j = 0; j < N; j++)
+	{
+		y[j] = y[j] / spDiag[j];
+
+		for (e = spLPtr[j]; e < spLPtr[j + 1]; e++)
+		{
+			y[spIndex[e]] -= spL[e] * y[j];
+		}
+	}
+
+	spNumericTime = MPI_Wtime() - start_time;
+}
+
+void Sparse_Order(void)
+{
+	int i, e, c, *nodes, *order, *level;
+
+	// Transpose of A, the factorization needs the columns of A as well.
+	spColPtr = calloc(N + 1, sizeof(int));
+	spRow = malloc((spNnz > 0 ? spNnz : 1) * sizeof(int));
+	spColValue = malloc((spNnz > 0 ? spNnz : 1) * sizeof(double));
+	spMark = malloc(N * sizeof(int));
+
+	for (e = 0; e < spNnz; e++)
+	{
+		spColPtr[spCol[e] + 1]++;
+	}
+
+	for (i = 0; i < N; i++)
+	{
+		spColPtr[i + 1] += spColPtr[i];
+		spMark[i] = spColPtr[i];
+	}
+
+	for (i = 0; i < N; i++)
+	{
+		for (e = spRowPtr[i]; e < spRowPtr[i + 1]; e++)
+		{
+			spRow[spMark[spCol[e]]] = i;
+			spColValue[spMark[spCol[e]]++] = spValue[e];
+		}
+	}
+
+	// Graph of A + A^T without the diagonal, counted then filled.
+	spAdjPtr = malloc((N + 1) * sizeof(int));
+	spAdj = malloc(2 * (size_t)(spNnz > 0 ? spNnz : 1) * sizeof(int));
+	spAdjPtr[0] = 0;
+
+	for (i = 0; i < N; i++)
+	{
+		spMark[i] = -1;
+	}
+
+	for (i = 0; i < N; i++)
+	{
+		spAdjPtr[i + 1] = spAdjPtr[i];
+		spMark[i] = i;
+
+		for (e = spRowPtr[i]; e < spRowPtr[i + 1]; e++)
+		{
+			c = spCol[e];
+
+			if (spMark[c] != i)
+			{
+				spMark[c] = i;
+				spAdj[spAdjPtr[i + 1]++] = c;
+			}
+		}
+
+		for (e = spColPtr[i]; e < spColPtr[i + 1]; e++)
+		{
+			c = spRow[e];
+
+			if (spMark[c] != i)
+			{
+				spMark[c] = i;
+				spAdj[spAdjPtr[i + 1]++] = c;
+			}
+		}
+	}
+
+	spPerm = malloc(N * sizeof(int));
+	spInverse = malloc(N * sizeof(int));
+	spRegionOf = malloc(N * sizeof(int));
+	spNext = 0;
+	spRegion = 0;
+	spStamp = 0;
+
+	for (i = 0; i < N; i++)
+	{
+		spMark[i] = 0;
+		spRegionOf[i] = 0;
+	}
+
+	if (strcmp(Ordering, "nd") == 0)
+	{
+		nodes = malloc(N * sizeof(int));
+
+		for (i = 0; i < N; i++)
+		{
+			nodes[i] = i;
+		}
+
+		Sparse_Dissect(nodes, N);
+		free(nodes);
+	}
+
+	else if (strcmp(Ordering, "rcm") == 0)
+	{
+		// Cuthill-McKee from a pseudo-peripheral node of each component,
+		// neighbours by increasing degree, then reversed.
+		order = malloc(N * sizeof(int));
+		level = malloc((N + 1) * sizeof(int));
+
+		for (i = 0; i < N; i++)
+		{
+			if (spRegionOf[i] != 0)
+			{
+				continue;
+			}
+
+			c = Sparse_Peripheral(i, 0, order, level, 1);
+
+			for (e = 0; e < level[c]; e++)
+			{
+				spRegionOf[order[e]] = -1;
+				spPerm[N - 1 - spNext++] = order[e];
+			}
+		}
+
+		free(order);
+		free(level);
+	}
+
+	else
+	{
+		for (i = 0; i < N; i++)
+		{
+			spPerm[i] = i;
+		}
+	}
+
+	for (i = 0; i < N; i++)
+	{
+		spInverse[spPerm[i]] = i;
+	}
+
+	free(spRegionOf);
+	spRegionOf = NULL;
+}
+
+int Sparse_BFS(int start, int id, int* order, int* level, int sorted)
+{
+	int head = 0, tail = 1, levels = 0, end, first, v, w, e, i, j;
+	int stamp = ++spStamp;
+
+	// Breadth first search over the nodes of region id, order holds the
+	// nodes level by level, level l starts at order[level[l]].
+	order[0] = start;
+	spMark[start] = stamp;
+
+	while (head < tail)
+	{
+		level[levels++] = head;
+
+		for (end = tail; head < end; head++)
+		{
+			v = order[head];
+			first = tail;
+
+			for (e = spAdjPtr[v]; e < spAdjPtr[v + 1]; e++)
+			{
+				w = spAdj[e];
+
+				if (spRegionOf[w] == id && spMark[w] != stamp)
+				{
+					spMark[w] = stamp;
+					order[tail++] = w;
+				}
+			}
+
+			// Insertion sort of the new neighbours by degree.
+			for (i = first + 1; sorted && i < tail; i++)
+			{
+				w = order[i];
+
+				for (j = i; j > first && DEGREE(order[j - 1]) > DEGREE(w); j--)
+				{
+					order[j] = order[j - 1];
+				}
+
+				order[j] = w;
+			}
+		}
+	}
+
+	level[levels] = tail;
+
+	return levels;
+}
+
+int Sparse_Peripheral(int start, int id, int* order, int* level, int sorted)
+{
+	int i, best, levels, next, tries;
+
+	// Restart the search from a low degree node of the last level while that
+	// makes the level structure deeper.
+	levels = Sparse_BFS(start, id, order, level, 0);
+
+	for (tries = 0; tries < PERIPHERAL_TRIES; tries++)
+	{
+		best = order[level[levels - 1]];
+
+		for (i = level[levels - 1]; i < level[levels]; i++)
+		{
+			best = (DEGREE(order[i]) < DEGREE(best)) ? order[i] : best;
+		}
+
+		next = Sparse_BFS(best, id, order, level, 0);
+
+		if (next <= levels)
+		{
+			break;
+		}
+
+		start = best;
+		levels = next;
+	}
+
+	return Sparse_BFS(start, id, order, level, sorted);
+}
+
+void Sparse_Dissect(int* nodes, int count)
+{
+	int i, levels, middle, reached, parts[2], *order, *level, *part[2];
+	int id = ++spRegion;
+
+	// Nested dissection, the middle level of a breadth first search from a
+	// pseudo-peripheral node separates the levels above it from those below.
+	// Both halves are numbered first and the separator last, so the two
+	// halves become independent subtrees of the elimination tree.
+	for (i = 0; i < count; i++)
+	{
+		spRegionOf[nodes[i]] = id;
+	}
+
+	if (count <= DISSECT_LEAF)
+	{
+		for (i = 0; i < count; i++)
+		{
+			spPerm[spNext++] = nodes[i];
+		}
+
+		return;
+	}
+
+	order = malloc(count * sizeof(int));
+	level = malloc((count + 1) * sizeof(int));
+	levels = Sparse_Peripheral(nodes[0], id, order, level, 0);
+	reached = level[levels];
+
+	if (reached < count)
+	{
+		// Not connected, the component and the rest are independent.
+		part[0] = malloc(reached * sizeof(int));
+		part[1] = malloc((count - reached) * sizeof(int));
+		memcpy(part[0], order, reached * sizeof(int));
+
+		for (i = 0, parts[1] = 0; i < count; i++)
+		{
+			if (spMark[nodes[i]] != spStamp)
+			{
+				part[1][parts[1]++] = nodes[i];
+			}
+		}
+
+		free(order);
+		free(level);
+		Sparse_Dissect(part[0], reached);
+		Sparse_Dissect(part[1], parts[1]);
+		free(part[0]);
+		free(part[1]);
+		return;
+	}
+
+	if (levels < 3)
+	{
+		// Too few levels for a separator.
+		for (i = 0; i < count; i++)
+		{
+			spPerm[spNext++] = order[i];
+		}
+
+		free(order);
+		free(level);
+		return;
+	}
+
+	middle = levels / 2;
+	parts[0] = level[middle];
+	parts[1] = count - level[middle + 1];
+	part[0] = malloc(parts[0] * sizeof(int));
+	part[1] = malloc(parts[1] * sizeof(int));
+	memcpy(part[0], order, parts[0] * sizeof(int));
+	memcpy(part[1], order + level[middle + 1], parts[1] * sizeof(int));
+
+	Sparse_Dissect(part[0], parts[0]);
+	Sparse_Dissect(part[1], parts[1]);
+
+	for (i = level[middle]; i < level[middle + 1]; i++)
+	{
+		spPerm[spNext++] = order[i];
+	}
+
+	free(part[0]);
+	free(part[1]);
+	free(order);
+	free(level);
+}
+
+void Sparse_Symbolic(void)
+{
+	int i, j, k, t, e, next, *ancestor, *height;
+	long *fill;
+
+	// Elimination tree of the reordered A + A^T, Liu's algorithm with path
+	// compression. spParent[j] is the first row below j in column j of L.
+	spParent = malloc(N * sizeof(int));
+	ancestor = malloc(N * sizeof(int));
+
+	for (k = 0; k < N; k++)
+	{
+		spParent[k] = -1;
+		ancestor[k] = -1;
+
+		for (e = spAdjPtr[spPerm[k]]; e < spAdjPtr[spPerm[k] + 1]; e++)
+		{
+			for (i = spInverse[spAdj[e]]; i != -1 && i < k; i = next)
+			{
+				next = ancestor[i];
+				ancestor[i] = k;
+
+				if (next == -1)
+				{
+					spParent[i] = k;
+				}
+			}
+		}
+	}
+
+	// Row j of L is the subtree of the etree reached from the columns k < j
+	// of A's row j, walking up until a node already seen for this row. Two
+	// passes, count then fill. Column k's pattern comes out sorted, and each
+	// row j lists the columns k it depends on with the position of j in k.
+	spLPtr = calloc(N + 1, sizeof(long));
+	spDepPtr = calloc(N + 1, sizeof(long));
+	fill = malloc(N * sizeof(long));
+
+	for (j = 0; j < N; j++)
+	{
+		spMark[j] = -1;
+	}
+
+	for (j = 0; j < N; j++)
+	{
+		spMark[j] = j;
+
+		for (e = spAdjPtr[spPerm[j]]; e < spAdjPtr[spPerm[j] + 1]; e++)
+		{
+			for (t = spInverse[spAdj[e]]; t < j && spMark[t] != j; t = spParent[t])
+			{
+				spMark[t] = j;
+				spLPtr[t + 1]++;
+				spDepPtr[j + 1]++;
+			}
+		}
+	}
+
+	for (j = 0; j < N; j++)
+	{
+		spLPtr[j + 1] += spLPtr[j];
+		spDepPtr[j + 1] += spDepPtr[j];
+		fill[j] = spLPtr[j];
+		spMark[j] = -1;
+	}
+
+	spIndex = malloc((spLPtr[N] > 0 ? spLPtr[N] : 1) * sizeof(int));
+	spDep = malloc((spDepPtr[N] > 0 ? spDepPtr[N] : 1) * sizeof(int));
+	spDepPos = malloc((spDepPtr[N] > 0 ? spDepPtr[N] : 1) * sizeof(long));
+
+	for (j = 0; j < N; j++)
+	{
+		long d = spDepPtr[j];
+
+		spMark[j] = j;
+
+		for (e = spAdjPtr[spPerm[j]]; e < spAdjPtr[spPerm[j] + 1]; e++)
+		{
+			for (t = spInverse[spAdj[e]]; t < j && spMark[t] != j; t = spParent[t])
+			{
+				spMark[t] = j;
+				spDep[d] = t;
+				spDepPos[d++] = fill[t];
+				spIndex[fill[t]++] = j;
+			}
+		}
+	}
+
+	// Children left per column, and the height of the tree.
+	spPending = calloc(N > 0 ? N : 1, sizeof(int));
+	spQueue = malloc(N * sizeof(int));
+	height = calloc(N > 0 ? N : 1, sizeof(int));
+	spHeight = (N > 0) ? 1 : 0;
+
+	for (j = 0; j < N; j++)
+	{
+		if (spParent[j] >= 0)
+		{
+			spPending[spParent[j]]++;
+			height[spParent[j]] = (height[j] + 1 > height[spParent[j]]) ? height[j] + 1 : height[spParent[j]];
+			spHeight = (height[spParent[j]] + 1 > spHeight) ? height[spParent[j]] + 1 : spHeight;
+		}
+	}
+
+	spL = malloc((spLPtr[N] > 0 ? spLPtr[N] : 1) * sizeof(double));
+	spU = malloc((spLPtr[N] > 0 ? spLPtr[N] : 1) * sizeof(double));
+	spDiag = malloc(N * sizeof(double));
+
+	free(ancestor);
+	free(height);
+	free(fill);
+	free(spAdjPtr);
+	free(spAdj);
+	spAdjPtr = spAdj = NULL;
+}
+
+void* ThreadSparseWork(void* input)
+{
+	int j, p;
+	int id = ((ThreadData*) input)->id;
+	double start_time;
+	double *wL = calloc(N, sizeof(double));
+	double *wU = calloc(N, sizeof(double));
+
+	// Take ready columns until all N are done.
+	pthread_mutex_lock(&spLock);
+
+	while (1)
+	{
+		while (spHead == spTail && spDone < N)
+		{
+			pthread_cond_wait(&spReady, &spLock);
+		}
+
+		if (spHead == spTail)
+		{
+			break;
+		}
+
+		j = spQueue[spHead++];
+		pthread_mutex_unlock(&spLock);
+
+		start_time = MPI_Wtime();
+		Sparse_Column(j, wL, wU);
+		busyTime[id] += MPI_Wtime() - start_time;
+
+		pthread_mutex_lock(&spLock);
+		spDone++;
+		p = spParent[j];
+
+		if (p >= 0 && --spPending[p] == 0)
+		{
+			spQueue[spTail++] = p;
+			pthread_cond_signal(&spReady);
+		}
+
+		if (spDone == N)
+		{
+			pthread_cond_broadcast(&spReady);
+		}
+	}
+
+	pthread_mutex_unlock(&spLock);
+	free(wL);
+	free(wU);
+
+	return NULL;
+}
+
+void Sparse_Column(int j, double* wL, double* wU)
+{
+	int i, k;
+	long d, e, p;
+	double ljk, ukj, pivot;
+
+	// Left-looking, column j of L and row j of U from A and the columns k
+	// of row j of L, which are all descendants of j and done. L holds the
+	// pivots and U is unit upper, as A after Work() with keepL.
+	for (e = spColPtr[spPerm[j]]; e < spColPtr[spPerm[j] + 1]; e++)
+	{
+		i = spInverse[spRow[e]];
+
+		if (i >= j)
+		{
+			wL[i] += spColValue[e];
+		}
+	}
+
+	for (e = spRowPtr[spPerm[j]]; e < spRowPtr[spPerm[j] + 1]; e++)
+	{
+		i = spInverse[spCol[e]];
+
+		if (i > j)
+		{
+			wU[i] += spValue[e];
+		}
+	}
+
+	for (d = spDepPtr[j]; d < spDepPtr[j + 1]; d++)
+	{
+		k = spDep[d];
+		p = spDepPos[d];
+		ljk = spL[p];
+		ukj = spU[p];
+		wL[j] -= ljk * ukj;
+
+		for (e = p + 1; e < spLPtr[k + 1]; e++)
+		{
+			// Elimination step.
+			wL[spIndex[e]] -= spL[e] * ukj;
+			wU[spIndex[e]] -= ljk * spU[e];
+		}
+	}
+
+	pivot = wL[j];
+	wL[j] = 0.0;
+	spDiag[j] = pivot;
+
+	if (pivot == 0.0)
+	{
+		spZeroPivot = 1;
+	}
+
+	for (e = spLPtr[j]; e < spLPtr[j + 1]; e++)
+	{
+		// Division step.
+		i = spIndex[e];
+		spL[e] = wL[i];
+		spU[e] = wU[i] / pivot;
+		wL[i] = 0.0;
+		wU[i] = 0.0;
+	}
+}
+
+void Back_Substitution_Sparse(void)
+{
+	int i, j;
+	long e;
+	double *v = malloc((N > 0 ? N : 1) * sizeof(double));
+
+	// U v = y bottom-up with the rows of U, then x = v in the original order.
+	for (j = N - 1; j >= 0; j--)
+	{
+		v[j] = y[j];
+
+		for (e = spLPtr[j]; e < spLPtr[j + 1]; e++)
+		{
+			v[j] -= spU[e] * v[spIndex[e]];
+		}
+	}
+
+	for (i = 0; i < N; i++)
+	{
+		x[spPerm[i]] = v[i];
+	}
+
+	free(v);
+}
+
+int First_Local_Row(int g)
+{
+	// Smallest local row whose global index is >= g.
+	if (g <= rank)
+	{
+		return 0;
+	}
+
+	return (g - rank + ranks - 1) / ranks;
+}
+
+void Back_Substitution(void)
+{
+	int i, j, k, top, bottom;
+
+	if (oocBuffer != NULL)
+	{
+		Back_Substitution_Out_Of_Core();
+		return;
+	}
+
+	if (spDiag != NULL)
+	{
+		Back_Substitution_Sparse();
+		return;
+	}
+
+	if (AB != NULL)
+	{
+		// Banded, only KU columns right of the diagonal.
+		for (i = N - 1; i >= 0; i--)
+		{
+			x[i] = y[i];
+
+			for (j = i + 1; j <= i + KU && j < N; j++)
+			{
+				x[i] = x[i] - AB[i][j - i + KL] * x[j];
+			}
+		}
+
+		return;
+	}
+
+	// After Work() A is unit upper triangular, so A x = y is solved bottom-up
+	// one block of rows at a time. The diagonal block is solved serially, then
+	// the rows above it are updated with the new x values in parallel.
+	// z holds the partially reduced y of the local rows, with one rank it is x.
+	z = (ranks > 1) ? malloc(rows * sizeof(double)) : x;
+
+	for (i = 0; i < rows; i++)
+	{
+		z[i] = y[i];
+	}
+
+	for (bottom = N; bottom > 0; bottom = top)
+	{
+		top = (bottom > BACK_BLOCK) ? (bottom - BACK_BLOCK) : 0;
+
+		for (k = bottom - 1; k >= top; k--)
+		{
+			if (k % ranks == rank)
+			{
+				x[k] = z[k / ranks];
+
+				for (j = k + 1; j < bottom; j++)
+				{
+					x[k] = x[k] - A[k / ranks][j] * x[j];
+				}
+			}
+
+			if (ranks > 1)
+			{
+				MPI_Bcast(&x[k], 1, MPI_DOUBLE, k % ranks, MPI_COMM_WORLD);
+			}
+		}
+
+		if (top == 0)
+		{
+			break;
+		}
+
+		// Thread the update of the local rows above the block.
+		Fork_Join(ThreadBackWork, top, bottom, 0, First_Local_Row(top));
+	}
+
+	if (z != x)
+	{
+		free(z);
+	}
+}
+
+void* ThreadBackWork(void* input)
+{
+	int i, j;
+	ThreadData threadData = *(ThreadData*) input;
+
+	for (i = threadData.start; i < threadData.stop; i++)
+	{
+		double sum = 0.0;
+
+		for (j = threadData.k; j < threadData.kstop; j++)
+		{
+			sum += A[i][j] * x[j];
+		}
+
+		z[i] = z[i] - sum;
+	}
+
+	return NULL;
+}
+
+void Solve_Multiple(void)
+{
+	int i, j, r, top, bottom;
+
+	// Solve A X = B for all RHS columns with the kept factors, L Y = B top-down
+	// then U X = Y bottom-up. Each block of rows is solved serially against
+	// its diagonal block, then the remaining rows are updated with the whole
+	// block in parallel, a matrix-matrix product over the RHS columns.
+	for (top = 0; top < N; top = bottom)
+	{
+		bottom = (top + SOLVE_BLOCK < N) ? (top + SOLVE_BLOCK) : N;
+
+		for (i = top; i < bottom; i++)
+		{
+			for (j = top; j < i; j++)
+			{
+				for (r = 0; r < RHS; r++)
+				{
+					B[i][r] = B[i][r] - A[i][j] * B[j][r];
+				}
+			}
+
+			for (r = 0; r < RHS; r++)
+			{
+				B[i][r] = B[i][r] / A[i][i];
+			}
+		}
+
+		if (bottom == N)
+		{
+			break;
+		}
+
+		// Thread the update of the rows below the block.
+		Fork_Join(ThreadBlockWork, top, bottom, bottom, N);
+	}
+
+	for (bottom = N; bottom > 0; bottom = top)
+	{
+		top = (bottom > SOLVE_BLOCK) ? (bottom - SOLVE_BLOCK) : 0;
+
+		for (i = bottom - 1; i >= top; i--)
+		{
+			for (j = i + 1; j < bottom; j++)
+			{
+				for (r = 0; r < RHS; r++)
+				{
+					B[i][r] = B[i][r] - A[i][j] * B[j][r];
+				}
+			}
+		}
+
+		if (top == 0)
+		{
+			break;
+		}
+
+		// Thread the update of the rows above the block.
+		Fork_Join(ThreadBlockWork, top, bottom, 0, top);
+	}
+}
+
+void* ThreadBlockWork(void* input)
+{
+	int i, j, r;
+	double l;
+	ThreadData threadData = *(ThreadData*) input;
+
+	// B(rows, :) -= A(rows, k..kstop) B(k..kstop, :)
+	for (i = threadData.start; i < threadData.stop; i++)
+	{
+		for (j = threadData.k; j < threadData.kstop; j++)
+		{
+			l = A[i][j];
+
+			for (r = 0; r < RHS; r++)
+			{
+				B[i][r] = B[i][r] - l * B[j][r];
+			}
+		}
+	}
+
+	return NULL;
+}
+
+int Work_Mixed(void)
+{
+	int i, j, k, fstride;
+	double anorm = 0.0, xnorm, rnorm, last = 0.0, sum;
+
+	// Factor a float copy of A, half the memory traffic and twice the SIMD
+	// width, then refine x in double against the original A until the
+	// residual is at double precision level. Returns 0 if refinement stalls.
+	fstride = (N + 15) & ~15;
+
+	if ((fstride / 16) % 2 == 0)
+	{
+		fstride += 16;
+	}
+
+	if (posix_memalign((void**)&Af_data, ALIGNMENT, (size_t)N * fstride * sizeof(float)) != 0)
+	{
+		printf("Could not allocate the float copy of A.\n");
+		exit(1);
+	}
+
+	Af = malloc(N * sizeof(float*));
+	xm = malloc(N * sizeof(double));
+	r = malloc(N * sizeof(double));
+
+	for (i = 0; i < N; i++)
+	{
+		Af[i] = Af_data + (size_t)i * fstride;
+		sum = 0.0;
+
+		for (j = 0; j < N; j++)
+		{
+			Af[i][j] = (float)A[i][j];
+			sum += (A[i][j] < 0.0) ? -A[i][j] : A[i][j];
+		}
+
+		anorm = (sum > anorm) ? sum : anorm;
+	}
+
+	for (k = 0; k < N; k++)
+	{
+		for (j = k+1; j < N; j++)
+		{
+			// Division step, the pivot stays in Af[k][k].
+			Af[k][j] = Af[k][j] / Af[k][k];
+		}
+
+		Fork_Join(ThreadFloatWork, k, 0, k + 1, N);
+	}
+
+	for (i = 0; i < N; i++)
+	{
+		xm[i] = b[i];
+	}
+
+	Float_Solve(xm);
+
+	for (refineIterations = 0; refineIterations < MAX_REFINE; refineIterations++)
+	{
+		// r = b - A xm
+		Fork_Join(ThreadResidualWork, 0, 0, 0, N);
+
+		rnorm = 0.0;
+		xnorm = 0.0;
+
+		for (i = 0; i < N; i++)
+		{
+			rnorm = (r[i] > rnorm) ? r[i] : ((-r[i] > rnorm) ? -r[i] : rnorm);
+			xnorm = (xm[i] > xnorm) ? xm[i] : ((-xm[i] > xnorm) ? -xm[i] : xnorm);
+		}
+
+		if (rnorm <= N * DBL_EPSILON * anorm * xnorm)
+		{
+			break;
+		}
+
+		if (refineIterations > 0 && rnorm > 0.5 * last)
+		{
+			// Stalled, the float factors are not good enough for this A.
+			break;
+		}
+
+		last = rnorm;
+
+		// Correction from the float factors.
+		Float_Solve(r);
+
+		for (i = 0; i < N; i++)
+		{
+			xm[i] = xm[i] + r[i];
+		}
+	}
+
+	free(Af_data);
+	free(Af);
+
+	return rnorm <= N * DBL_EPSILON * anorm * xnorm;
+}
+
+void* ThreadFloatWork(void* input)
+{
+	int i, j;
+	float l;
+	ThreadData threadData = *(ThreadData*) input;
+
+	for (i = threadData.start; i < threadData.stop; i++)
+	{
+		l = Af[i][threadData.k];
+
+		for (j = threadData.k+1; j < N; j++)
+		{
+			// Elimination step, the multiplier stays in Af[i][k].
+			Af[i][j] = Af[i][j] - l * Af[threadData.k][j];
+		}
+	}
+
+	return NULL;
+}
+
+void* ThreadResidualWork(void* input)
+{
+	int i, j;
+	double sum;
+	ThreadData threadData = *(ThreadData*) input;
+
+	for (i = threadData.start; i < threadData.stop; i++)
+	{
+		sum = 0.0;
+
+		for (j = 0; j < N; j++)
+		{
+			sum += A[i][j] * xm[j];
+		}
+
+		r[i] = b[i] - sum;
+	}
+
+	return NULL;
+}
+
+void Float_Solve(double* v)
+{
+	int i, j;
+
+	// L v = v then U v = v with the float factors, accumulated in double.
+	for (i = 0; i < N; i++)
+	{
+		for (j = 0; j < i; j++)
+		{
+			v[i] = v[i] - Af[i][j] * v[j];
+		}
+
+		v[i] = v[i] / Af[i][i];
+	}
+
+	for (i = N - 1; i >= 0; i--)
+	{
+		for (j = i + 1; j < N; j++)
+		{
+			v[i] = v[i] - Af[i][j] * v[j];
+		}
+	}
+}
+
+void Save_Original(void)
+{
+	int i, width = (AB != NULL) ? KL + KU + 1 : N;
+	int copyStride = (width + 7) & ~7;
+	int copyRows = (AB != NULL) ? N : rows;
+
+	A0_band = (AB != NULL);
+
+	if (oocBuffer != NULL || spRowPtr != NULL)
+	{
+		// A does not fit, Verify() generates its rows again. The sparse
+		// kernel never overwrites its CSR input.
+		b0 = malloc(N * sizeof(double));
+		memcpy(b0, b, N * sizeof(double));
+		A0 = NULL;
+		A0_data = NULL;
+		return;
+	}
+
+	// Keep the original A (or its band) and b, the solve overwrites both.
+	if (posix_memalign((void**)&A0_data, ALIGNMENT, (size_t)(copyRows > 0 ? copyRows : 1) * copyStride * sizeof(double)) != 0 ||
+		posix_memalign((void**)&b0, ALIGNMENT, (rows > 0 ? rows : 1) * sizeof(double)) != 0)
+	{
+		printf("Could not allocate the verification copy, verification is off.\n");
+		VERIFY = 0;
+		return;
+	}
+
+	A0 = malloc((copyRows > 0 ? copyRows : 1) * sizeof(double*));
+
+	for (i = 0; i < copyRows; i++)
+	{
+		A0[i] = A0_data + (size_t)i * copyStride;
+	}
+
+	Fork_Join(ThreadSaveWork, 0, width, 0, copyRows);
+}
+
+void* ThreadSaveWork(void* input)
+{
+	int i;
+	ThreadData threadData = *(ThreadData*) input;
+
+	for (i = threadData.start; i < threadData.stop; i++)
+	{
+		memcpy(A0[i], (AB != NULL) ? AB[i] : A[i], threadData.kstop * sizeof(double));
+		b0[i] = b[i];
+	}
+
+	return NULL;
+}
+
+int Verify(void)
+{
+	int i;
+	double norms[3] = { 0.0, 0.0, 0.0 }, all[3], xnorm = 0.0, error, threshold;
+	double verify_time = MPI_Wtime();
+
+	// r = b - A x with the original A and b, in parallel over the local rows.
+	Fork_Join(ThreadVerifyWork, 0, 0, 0, A0_band ? N : rows);
+
+	for (i = 0; i < THREADS; i++)
+	{
+		norms[0] = (verifyNorms[i][0] > norms[0]) ? verifyNorms[i][0] : norms[0];
+		norms[1] = (verifyNorms[i][1] > norms[1]) ? verifyNorms[i][1] : norms[1];
+		norms[2] = (verifyNorms[i][2] > norms[2]) ? verifyNorms[i][2] : norms[2];
+	}
+
+	MPI_Allreduce(norms, all, 3, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+	for (i = 0; i < N; i++)
+	{
+		xnorm = (x[i] > xnorm) ? x[i] : ((-x[i] > xnorm) ? -x[i] : xnorm);
+	}
+
+	// Normwise backward error, ||b - A x|| / (||A|| ||x|| + ||b||).
+	error = all[0] / (all[1] * xnorm + all[2]);
+	threshold = VERIFY_SCALE * N * DBL_EPSILON;
+
+	if (rank == 0)
+	{
+		printf("Residual ||b - Ax||: %e\n", all[0]);
+		printf("Backward error: %e (threshold %e) %s\n", error, threshold,
+			(error <= threshold) ? "PASSED" : "FAILED");
+		printf("Verification time: %f\n", MPI_Wtime() - verify_time);
+	}
+
+	free(A0_data);
+	free(A0);
+	free(b0);
+
+	// NaN fails too.
+	return !(error <= threshold);
+}
+
+void* ThreadVerifyWork(void* input)
+{
+	int i, j, first, last, offset;
+	double s0, s1, s2, s3, a0, a1, a2, a3, sum, rowSum, value;
+	double rmax = 0.0, amax = 0.0, bmax = 0.0;
+	double *row, *generated = NULL;
+	ThreadData threadData = *(ThreadData*) input;
+
+	if (A0 == NULL && spRowPtr == NULL)
+	{
+		// Out-of-core, no copy of A, each row is generated again.
+		generated = malloc(N * sizeof(double));
+	}
+
+	for (i = threadData.start; i < threadData.stop; i++)
+	{
+		row = (A0 != NULL) ? A0[i] : generated;
+
+		for (j = 0; generated != NULL && j < N; j++)
+		{
+			generated[j] = Initial_Value(i, j);
+		}
+
+		// Dense rows span all columns, band rows the columns around i.
+		first = 0;
+		last = N;
+		offset = 0;
+
+		if (A0_band)
+		{
+			first = (i - KL > 0) ? i - KL : 0;
+			last = (i + KU + 1 < N) ? i + KU + 1 : N;
+			offset = KL - i;
+		}
+
+		// Four independent sums so the loop vectorizes without reassociation.
+		s0 = s1 = s2 = s3 = 0.0;
+		a0 = a1 = a2 = a3 = 0.0;
+
+		if (A0 == NULL && spRowPtr != NULL)
+		{
+			// Sparse, the entries of row i in the CSR input.
+			for (j = spRowPtr[i]; j < spRowPtr[i + 1]; j++)
+			{
+				s0 += spValue[j] * x[spCol[j]];
+				a0 += (spValue[j] < 0.0) ? -spValue[j] : spValue[j];
+			}
+
+			last = first;
+		}
+
+		for (j = first; j + 3 < last; j += 4)
+		{
+			s0 += row[j + offset] * x[j];
+			s1 += row[j + offset + 1] * x[j + 1];
+			s2 += row[j + offset + 2] * x[j + 2];
+			s3 += row[j + offset + 3] * x[j + 3];
+			a0 += (row[j + offset] < 0.0) ? -row[j + offset] : row[j + offset];
+			a1 += (row[j + offset + 1] < 0.0) ? -row[j + offset + 1] : row[j + offset + 1];
+			a2 += (row[j + offset + 2] < 0.0) ? -row[j + offset + 2] : row[j + offset + 2];
+			a3 += (row[j + offset + 3] < 0.0) ? -row[j + offset + 3] : row[j + offset + 3];
+		}
+
+		for (; j < last; j++)
+		{
+			s0 += row[j + offset] * x[j];
+			a0 += (row[j + offset] < 0.0) ? -row[j + offset] : row[j + offset];
+		}
+
+		sum = (s0 + s1) + (s2 + s3);
+		rowSum = (a0 + a1) + (a2 + a3);
+		value = b0[i];
+
+		rmax = (value - sum > rmax) ? value - sum : ((sum - value > rmax) ? sum - value : rmax);
+		amax = (rowSum > amax) ? rowSum : amax;
+		bmax = (value > bmax) ? value : ((-value > bmax) ? -value : bmax);
+
+		if (sum != sum)
+		{
+			// NaN, fail the check.
+			rmax = DBL_MAX;
+		}
+	}
+
+	free(generated);
+	verifyNorms[threadData.id][0] = rmax;
+	verifyNorms[threadData.id][1] = amax;
+	verifyNorms[threadData.id][2] = bmax;
+
+	return NULL;
+}
+
+void Allocate_Matrix()
+{
+	int i;
+
+	if (InFile != NULL)
+	{
+		// A is used in place from the mapped file, N comes from the file.
+		Map_Matrix();
+	}
+
+	else if (strcmp(Init, "band") == 0)
+	{
+		// Banded input, no dense storage.
+		rows = N;
+		stride = 0;
+		Allocate_Band();
+	}
+
+	else if (strcmp(Init, "sparse") == 0)
+	{
+		// Sparse input, CSR storage only.
+		Allocate_Sparse();
+		rows = N;
+		stride = 0;
+	}
+
+	else if (strcmp(Kernel, "ooc") == 0)
+	{
+		// A on disk, only the window in memory.
+		rows = N;
+		stride = 0;
+		Allocate_Out_Of_Core();
+	}
+
+	else
+	{
+		// Padded rows, the same layout as the solver library.
+		stride = Gauss_Stride(N);
+
+		// Each rank only stores its own rows.
+		rows = (N - rank + ranks - 1) / ranks;
+		A_bytes = (size_t)(rows > 0 ? rows : 1) * stride * sizeof(double);
+		A_mapped = 0;
+
+		if (HUGE == 2)
+		{
+			// Explicit huge pages, needs pages reserved in /proc/sys/vm/nr_hugepages.
+			size_t bytes = (A_bytes + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+			A_data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+			if (A_data == MAP_FAILED)
+			{
+				printf("MAP_HUGETLB failed, using transparent huge pages.\n");
+				HUGE = 1;
+			}
+
+			else
+			{
+				A_bytes = bytes;
+				A_mapped = 1;
+			}
+		}
+
+		if (!A_mapped)
+		{
+			size_t alignment = (HUGE == 1) ? HUGE_PAGE_SIZE : ALIGNMENT;
+
+			if (posix_memalign((void**)&A_data, alignment, A_bytes) != 0)
+			{
+				printf("Could not allocate %zu bytes for matrix A.\n", A_bytes);
+				exit(1);
+			}
+
+			if (HUGE == 1)
+			{
+				// Ask for transparent huge pages, ignored if THP is disabled.
+				madvise(A_data, A_bytes, MADV_HUGEPAGE);
+			}
+		}
+
+		A = malloc((rows > 0 ? rows : 1) * sizeof(double*));
+
+		for (i = 0; i < rows; i++)
+		{
+			A[i] = A_data + (size_t)i * stride;
+		}
+	}
+
+	if (RHS > 0)
+	{
+		// Right hand sides, rows padded to whole cache lines.
+		B_stride = (RHS + 7) & ~7;
+
+		if (posix_memalign((void**)&B_data, ALIGNMENT, (size_t)N * B_stride * sizeof(double)) != 0)
+		{
+			printf("Could not allocate %d right hand sides.\n", RHS);
+			exit(1);
+		}
+
+		B = malloc(N * sizeof(double*));
+
+		for (i = 0; i < N; i++)
+		{
+			B[i] = B_data + (size_t)i * B_stride;
+		}
+	}
+
+	if (posix_memalign((void**)&b, ALIGNMENT, N * sizeof(double)) != 0 ||
+		posix_memalign((void**)&y, ALIGNMENT, N * sizeof(double)) != 0 ||
+		posix_memalign((void**)&x, ALIGNMENT, N * sizeof(double)) != 0 ||
+		posix_memalign((void**)&pivot, ALIGNMENT, (N + 1) * sizeof(double)) != 0)
+	{
+		printf("Could not allocate vectors b, y, x and the pivot buffer.\n");
+		exit(1);
+	}
+}
+
+void Allocate_Band()
+{
+	int i, width;
+
+	if (KL < 0 || KU < 0)
+	{
+		KL = (KL < 0) ? 8 : KL;
+		KU = (KU < 0) ? KL : KU;
+	}
+
+	// Band rows padded to whole cache lines.
+	width = (KL + KU + 1 + 7) & ~7;
+
+	if (posix_memalign((void**)&AB_data, ALIGNMENT, (size_t)N * width * sizeof(double)) != 0)
+	{
+		printf("Could not allocate the band storage.\n");
+		exit(1);
+	}
+
+	memset(AB_data, 0, (size_t)N * width * sizeof(double));
+	AB = malloc(N * sizeof(double*));
+
+	for (i = 0; i < N; i++)
+	{
+		AB[i] = AB_data + (size_t)i * width;
+	}
+}
+
+void Map_Matrix()
+{
+	int fd, i, valid;
+	FileHeader header;
+	struct stat status;
+	size_t fileSize;
+	char *base;
+
+	fd = open(InFile, O_RDONLY);
+
+	valid = (fd >= 0 && read(fd, &header, sizeof(header)) == sizeof(header) && fstat(fd, &status) == 0 &&
+		status.st_size >= 0 && memcmp(header.magic, FILE_MAGIC, 8) == 0 && header.dtype == sizeof(double) &&
+		header.n > 0 && header.rows == header.n && header.b_offset != 0 && header.stride >= header.n &&
+		header.a_offset >= (long long)sizeof(header) && header.b_offset >= (long long)sizeof(header) &&
+		header.a_offset % sizeof(double) == 0 && header.b_offset % sizeof(double) == 0);
+
+	// A and b must lie inside the file, a truncated file would fault on the
+	// first access to a missing page. Sizes are compared as size_t once they
+	// are known to be positive, without adding anything that could overflow.
+	if (valid)
+	{
+		fileSize = (size_t)status.st_size;
+		valid = ((size_t)header.a_offset <= fileSize && (size_t)header.b_offset <= fileSize &&
+			(size_t)header.n * header.stride <= (fileSize - (size_t)header.a_offset) / sizeof(double) &&
+			(size_t)header.n <= (fileSize - (size_t)header.b_offset) / sizeof(double));
+	}
+
+	if (!valid)
+	{
+		printf("%s is not a binary matrix file with A and b.\n", InFile);
+		exit(1);
+	}
+
+	// Private mapping, the elimination writes to the pages copy-on-write and
+	// the file is never modified.
+	base = mmap(NULL, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (base == MAP_FAILED)
+	{
+		printf("Could not map %s.\n", InFile);
+		exit(1);
+	}
+
+	N = header.n;
+	stride = header.stride;
+	rows = (N - rank + ranks - 1) / ranks;
+	A_data = (double*)base;
+	A_bytes = status.st_size;
+	A_mapped = 1;
+	fileB = (double*)(base + header.b_offset);
+
+	// Each rank points at its own rows.
+	A = malloc((rows > 0 ? rows : 1) * sizeof(double*));
+
+	for (i = 0; i < rows; i++)
+	{
+		A[i] = (double*)(base + header.a_offset) + (size_t)(i * ranks + rank) * stride;
+	}
+}
+
+void Write_File(char* name, int matrixRows, double* vector)
+{
+	int fd, i;
+	FileHeader header;
+	size_t size;
+	char *base;
+
+	// Write A (if matrixRows > 0) and the vector through a shared mapping.
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FILE_MAGIC, 8);
+	header.n = N;
+	header.dtype = sizeof(double);
+	header.stride = stride;
+	header.rows = matrixRows;
+	header.a_offset = (matrixRows > 0) ? FILE_HEADER_SIZE : 0;
+	header.b_offset = FILE_HEADER_SIZE + (long long)matrixRows * stride * sizeof(double);
+	size = header.b_offset + (size_t)N * sizeof(double);
+
+	fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0 || ftruncate(fd, size) != 0)
+	{
+		printf("Could not create %s.\n", name);
+		return;
+	}
+
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (base == MAP_FAILED)
+	{
+		printf("Could not map %s.\n", name);
+		return;
+	}
+
+	memcpy(base, &header, sizeof(header));
+
+	for (i = 0; i < matrixRows; i++)
+	{
+		memcpy(base + header.a_offset + (size_t)i * stride * sizeof(double), A[i], N * sizeof(double));
+	}
+
+	memcpy(base + header.b_offset, vector, N * sizeof(double));
+	munmap(base, size);
+}
+
+void Free_Matrix()
+{
+	if (A_mapped)
+	{
+		munmap(A_data, A_bytes);
+	}
+
+	else
+	{
+		free(A_data);
+	}
+
+	if (oocBuffer != NULL)
+	{
+		int p;
+
+		// The panel file is scratch space.
+		for (p = 0; p < window; p++)
+		{
+			free(oocBuffer[p]);
+		}
+
+		free(oocBuffer);
+		free(oocColumn);
+		close(oocFd);
+		unlink(OocFile);
+	}
+
+	free(A);
+	free(AB_data);
+	free(AB);
+	free(spRowPtr);
+	free(spCol);
+	free(spValue);
+	free(spColPtr);
+	free(spRow);
+	free(spColValue);
+	free(spPerm);
+	free(spInverse);
+	free(spMark);
+	free(spParent);
+	free(spLPtr);
+	free(spIndex);
+	free(spL);
+	free(spU);
+	free(spDiag);
+	free(spDepPtr);
+	free(spDep);
+	free(spDepPos);
+	free(spPending);
+	free(spQueue);
+	free(b);
+	free(y);
+	free(x);
+	free(pivot);
+
+	if (RHS > 0)
+	{
+		free(B_data);
+		free(B);
+	}
+}
+
+void Init_Matrix()
+{
+    int i, j;
+	double init_time;
+
+	if (rank == 0)
+	{
+	 	printf("Mode      = Parallell");
+	    printf("\nSize      = %dx%d ", N, N);
+	    printf("\nMaxnum    = %d \n", maxnum);
+	    printf("Init	  = %s \n", (InFile != NULL) ? InFile : ((SparseFile != NULL) ? SparseFile : Init));
+	    printf("Seed      = %llu \n", seed);
+	    printf("Stride    = %d \n", stride);
+	    printf("Huge      = %d \n", HUGE);
+	    printf("Ranks     = %d \n", ranks);
+	    printf("Threads   = %d (pinning %s%s) \n", THREADS, Pinning, SMT ? "" : ", no SMT");
+	    printf("Kernel    = %s \n", Kernel);
+	    printf("Keep L    = %d \n", KEEP_L);
+	    printf("Mixed     = %d \n", MIXED);
+
+		if (AB != NULL)
+		{
+		    printf("Band      = %d lower, %d upper \n", KL, KU);
+		}
+
+		if (RHS > 0)
+		{
+		    printf("RHS       = %d \n", RHS);
+		}
+
+		if (strcmp(Kernel, "sparse") == 0)
+		{
+		    printf("Ordering  = %s \n", Ordering);
+		}
+
+		if (strcmp(Kernel, "tile") == 0)
+		{
+		    printf("Tile size = %d \n", tileSize);
+		}
+
+		if (strcmp(Kernel, "fork") == 0)
+		{
+		    printf("Row chunk = %d \n", CHUNK);
+		}
+
+		if (strcmp(Kernel, "ooc") == 0)
+		{
+		    printf("Panels    = %d of %d columns, %d in memory (%s) \n", (N + tileSize - 1) / tileSize, tileSize, window, OocFile);
+		}
+	    printf("Initializing matrix...\n");
+	}
+
+	init_time = MPI_Wtime();
+
+	// Fill the rows on the threads that later update them, so the pages are
+	// first touched (and placed) by their user. The fork and pipelined
+	// kernels own rows cyclically, the others split them in blocks.
+	if (oocBuffer != NULL)
+	{
+		Init_Out_Of_Core();
+	}
+
+	else if (InFile == NULL)
+	{
+		if (strcmp(Kernel, "fork") == 0 || strcmp(Kernel, "pipe") == 0 || ranks > 1)
+		{
+			Fork_Join_Owned(ThreadInitWork, 0, 0, rows);
+		}
+
+		else
+		{
+			Fork_Join(ThreadInitWork, 0, 1, 0, rows);
+		}
+	}
+
+    // Initialize vectors b, y and x.
+	if (InFile != NULL)
+	{
+	    for (i = 0; i < rows; i++) 
+		{
+			b[i] = fileB[i * ranks + rank];
+			y[i] = 1.0;
+	    }
+	}
+
+    for (i = 0; i < N; i++) 
+	{
+		x[i] = 0.0;
+    }
+
+	if (RHS > 0 && ranks == 1)
+	{
+		// The first right hand side is b, the others are random load cases.
+		for (i = 0; i < N; i++)
+		{
+			B[i][0] = b[i];
+
+			for (j = 1; j < RHS; j++)
+			{
+				B[i][j] = (double)(Gauss_Random(seed + 1, i, j) % maxnum) + 1.0;
+			}
+		}
+	}
+
+	if (rank == 0)
+	{
+	    printf("Done! (%f seconds)\n\n", MPI_Wtime() - init_time);
+	}
+
+    if (PRINT == 1 && ranks == 1)
+	{
+		printf("===== BEFORE GUASSIAN ELIMINATION =====\n");
+		Print_Matrix();
+	}
+}
+
+void* ThreadInitWork(void* input)
+{
+	int i, j, g;
+	ThreadData threadData = *(ThreadData*) input;
+
+	// Owned local rows from start below stop, as in ThreadWork().
+	for (i = threadData.start; i < threadData.stop; i = Next_Owned_Row(i))
+	{
+		g = i * ranks + rank;
+
+		if (strcmp(Init, "rand") == 0 || strcmp(Init, "fast") == 0)
+		{
+			for (j = 0; j < N; j++)
+			{
+				A[i][j] = Initial_Value(g, j);
+			}
+		}
+
+		if (strcmp(Init, "sparse") == 0 && SparseFile == NULL)
+		{
+			int e = spRowPtr[i];
+
+			// Five point stencil, diagonally dominant.
+			if (g - spGrid >= 0)
+			{
+				spCol[e++] = g - spGrid;
+			}
+
+			if (g % spGrid > 0)
+			{
+				spCol[e++] = g - 1;
+			}
+
+			spCol[e++] = g;
+
+			if (g % spGrid < spGrid - 1 && g + 1 < N)
+			{
+				spCol[e++] = g + 1;
+			}
+
+			if (g + spGrid < N)
+			{
+				spCol[e++] = g + spGrid;
+			}
+
+			for (e = spRowPtr[i]; e < spRowPtr[i + 1]; e++)
+			{
+				spValue[e] = (spCol[e] == g) ? (double)(5 * maxnum) : (double)(Gauss_Random(seed, g, spCol[e]) % maxnum) + 1.0;
+			}
+		}
+
+		if (strcmp(Init, "band") == 0)
+		{
+			for (j = g - KL; j <= g + KU; j++)
+			{
+				if (j < 0 || j >= N)
+				{
+					continue;
+				}
+
+				if (g == j)
+				{
+					// Diagonal dominance over the whole band.
+					AB[i][KL] = (double)((KL + KU + 1) * maxnum);
+				}
+
+				else
+				{
+					AB[i][j - g + KL] = (double)(Gauss_Random(seed, g, j) % maxnum) + 1.0;
+				}
+			}
+		}
+
+		b[i] = 2.0;
+		y[i] = 1.0;
+	}
+
+	return NULL;
+}
+
+void Profile_Key(char* key, int size)
+{
+	char line[256], *model = "unknown", *end;
+	FILE *file = fopen("/proc/cpuinfo", "r");
+
+	// "CPU model|online cores", a profile line is only used on the same kind
+	// of machine.
+	while (file != NULL && fgets(line, sizeof(line), file) != NULL)
+	{
+		if (strncmp(line, "model name", 10) == 0 && (model = strchr(line, ':')) != NULL)
+		{
+			model += 2;
+			end = strchr(model, '\n');
 
-// Thread variables.
-pthread_t thread[THREADS];
-typedef struct
-{
-	int k;
-	int start;
-	int stop;
-} ThreadData;
+			if (end != NULL)
+			{
+				*end = '\0';
+			}
 
-ThreadData threadData[THREADS];
+			break;
+		}
 
-void Work(void);
-void* ThreadWork(void*);
-void Init_Matrix(void);
-void Print_Matrix(void);
-void Read_Options(int, char **);
+		model = "unknown";
+	}
 
-void Init_Default()
-{
-    N = MAX_SIZE;
-    Init = "rand";
-    maxnum = 15.0;
-    PRINT = 0;
+	snprintf(key, size, "%s|%ld", model, sysconf(_SC_NPROCESSORS_ONLN));
+
+	if (file != NULL)
+	{
+		fclose(file);
+	}
 }
 
-int main(int argc, char **argv)
+void Load_Profile(void)
 {
-	MPI_Init(&argc, &argv);
-	double start_time, end_time;
+	char key[256], line[512], kernel[16];
+	int threads, tile, chunk, length;
+	FILE *file;
 
-    int i;
+	file = fopen(ProfileFile, "r");
 
-	for(i = 0; i < THREADS; i++)
+	if (file == NULL)
 	{
-		threadData[i].k = 0;
-		threadData[i].start = 0;
-		threadData[i].stop = 0;
+		return;
 	}
 
-	// Init default values.
-    Init_Default();
+	Profile_Key(key, sizeof(key));
+	length = strlen(key);
 
-	// Read arguments.
-    Read_Options(argc, argv);
+	// Lines are "key<tab>kernel threads tile chunk", profiles saved before
+	// the chunk was tuned have no chunk.
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		chunk = 1;
 
-	// Init the matrix.
-    Init_Matrix();
+		if (strncmp(line, key, length) != 0 || line[length] != '\t' ||
+			sscanf(line + length + 1, "%15s %d %d %d", kernel, &threads, &tile, &chunk) < 3)
+		{
+			continue;
+		}
 
-	// Start timer.
-	start_time = MPI_Wtime();
+		// -C, -r, -T and several ranks only work with the fork kernel, a
+		// tuned kernel must not quietly turn them off.
+		if (Kernel == NULL && (CHECKPOINT > 0 || RESTART == 1 || TraceFile != NULL || ranks > 1) &&
+			strcmp(kernel, "fork") != 0)
+		{
+			if (rank == 0)
+			{
+				printf("Profile: -C, -r, -T and several ranks need the fork kernel, not using the tuned %s kernel.\n", kernel);
+			}
 
-	// Do guassian elimination.
-    Work();
+			Kernel = "fork";
+		}
 
-	// Stop timer.
-	end_time = MPI_Wtime();
+		else if (Kernel == NULL)
+		{
+			Kernel = strdup(kernel);
+		}
 
-    if (PRINT == 1)
-	{
-		printf("===== AFTER GUASSIAN ELIMINATION ======\n");
-		Print_Matrix();
-		printf("=======================================\n\n");
+		THREADS = (THREADS <= 0) ? threads : THREADS;
+		tileSize = (tileSize <= 0) ? tile : tileSize;
+		CHUNK = (CHUNK <= 0) ? chunk : CHUNK;
 	}
 
-	double time_taken = (end_time - start_time);
-	printf("Execution time: %f\n", time_taken);
+	fclose(file);
 }
 
-void Work(void)
+void Save_Profile(char* kernel, int threads, int tile, int chunk)
 {
-    int i, j, k, offset;
+	char key[256], line[512], **lines = NULL;
+	int i, count = 0, length;
+	FILE *file;
 
-    // Gaussian elimination algorithm, Algo 8.4 from Grama.
-    for (k = 0; k < N; k++) 
+	Profile_Key(key, sizeof(key));
+	length = strlen(key);
+	file = fopen(ProfileFile, "r");
+
+	// Keep the other machines' lines, replace this one's.
+	while (file != NULL && fgets(line, sizeof(line), file) != NULL)
 	{
-		for (j = k+1; j < N; j++)
+		if (strncmp(line, key, length) != 0 || line[length] != '\t')
 		{
-			// Division step.
-			A[k][j] = A[k][j] / A[k][k]; 
+			lines = realloc(lines, (count + 1) * sizeof(char*));
+			lines[count++] = strdup(line);
 		}
+	}
 
-		y[k] = b[k] / A[k][k];
-		A[k][k] = 1.0;
+	if (file != NULL)
+	{
+		fclose(file);
+	}
 
-		// Calculate offset
-		offset = (N - (k+1)) / THREADS;
+	file = fopen(ProfileFile, "w");
 
-		// Thread the elimination step.
-		for(i = 0; i < (THREADS - 1); i++)
-		{
-			// Set data and create the thread.
-			threadData[i].k = k;
-			threadData[i].start	= (k + 1) + (offset * i);
-			threadData[i].stop	= (k + 1) + (offset * (i + 1));
-			pthread_create(&thread[i], NULL, ThreadWork, (void*)&threadData[i]);
-		}
+	if (file == NULL)
+	{
+		perror(ProfileFile);
+		return;
+	}
 
-		// Set data, and create last thread.
-		threadData[(THREADS - 1)].k = k;
-		threadData[(THREADS - 1)].start	= (k + 1) + (offset * (THREADS - 1));
-		threadData[(THREADS - 1)].stop	= N;
-		pthread_create(&thread[THREADS - 1], NULL, ThreadWork, (void*)&threadData[(THREADS - 1)]);
+	for (i = 0; i < count; i++)
+	{
+		fputs(lines[i], file);
+		free(lines[i]);
+	}
 
-		// Wait for all threads to terminate.
-		for (i = 0; i < THREADS; i++)
-		{
-			pthread_join(thread[i], NULL);
-		}
-    }
+	fprintf(file, "%s\t%s %d %d %d\n", key, kernel, threads, tile, chunk);
+	fclose(file);
+	free(lines);
 }
 
-void* ThreadWork(void* input)
+void Auto_Tune(char* program)
 {
-	int i, j;
-	ThreadData threadData = *(ThreadData*) input;
-		
-	for (i = threadData.start; i < threadData.stop; i++) 
+	char *kernels[] = { "fork", "fork", "fork", "fork", "pipe", "rec", "pool", "tile", "tile", "tile" };
+	int tiles[] = { TILE_SIZE, TILE_SIZE, TILE_SIZE, TILE_SIZE, TILE_SIZE, TILE_SIZE, TILE_SIZE, 64, 128, 256 };
+	int chunks[] = { 1, 4, 16, 64, 1, 1, 1, 1, 1, 1 };
+	int cores = sysconf(_SC_NPROCESSORS_ONLN), size = (N < TUNE_SIZE) ? N : TUNE_SIZE;
+	int c, i, count = 0, threads[64], bestThreads = 1, bestTile = TILE_SIZE, bestChunk = 1;
+	char *bestKernel = "fork";
+	double time, best = 0.0;
+
+	printf("Auto-tuning on %dx%d matrices...\n", size, size);
+
+	// Every kernel, fork row chunk and tile size with 1, 2, 4, ... threads
+	// and all cores.
+	for (i = 1; i < cores && count < 63; i *= 2)
 	{
-		for (j = threadData.k+1; j < N; j++)
+		threads[count++] = i;
+	}
+
+	threads[count++] = cores;
+
+	for (i = 0; i < count; i++)
+	{
+		for (c = 0; c < (int)(sizeof(kernels) / sizeof(kernels[0])); c++)
 		{
-			// Elimination step.
-			A[i][j] = A[i][j] - A[i][threadData.k] * A[threadData.k][j]; 
-		}
+			time = Calibrate(program, kernels[c], threads[i], tiles[c], chunks[c]);
+			printf("  %-4s threads %2d tile %3d chunk %2d: %f\n", kernels[c], threads[i], tiles[c], chunks[c], time);
 
-		b[i] = b[i] - A[i][threadData.k] * y[threadData.k];
-		A[i][threadData.k] = 0.0;
+			if (time > 0.0 && (best == 0.0 || time < best))
+			{
+				best = time;
+				bestKernel = kernels[c];
+				bestThreads = threads[i];
+				bestTile = tiles[c];
+				bestChunk = chunks[c];
+			}
+		}
 	}
+
+	printf("Tuned: kernel %s, %d threads, tile %d, chunk %d, saved to %s\n\n", bestKernel, bestThreads, bestTile,
+		bestChunk, ProfileFile);
+	Save_Profile(bestKernel, bestThreads, bestTile, bestChunk);
 }
 
-void Init_Matrix()
+double Calibrate(char* program, char* kernel, int threads, int tile, int chunk)
 {
-    int i, j;
+	char command[4096], line[256], quoted[3][1024];
+	double time, best = -1.0;
+	int run, length, size = (N < TUNE_SIZE) ? N : TUNE_SIZE;
+	FILE *pipe;
 
- 	printf("Mode      = Parallell");
-    printf("\nSize      = %dx%d ", N, N);
-    printf("\nMaxnum    = %d \n", maxnum);
-    printf("Init	  = %s \n", Init);
-    printf("Initializing matrix...\n");
- 
-    if (strcmp(Init, "rand") == 0) 
+	// A separate run of this program, so the calibration leaves no state
+	// behind. The options given fix all tuned settings. Paths and names are
+	// quoted, popen() hands the line to the shell.
+	length = snprintf(command, sizeof(command), "%s -n %d -K %s -t %d -b %d -G %d -p %s -S %d -H %d -V 0 -a %s",
+		Shell_Quote(quoted[0], sizeof(quoted[0]), program), size, kernel, threads, tile, chunk,
+		Shell_Quote(quoted[1], sizeof(quoted[1]), Pinning), SMT, HUGE,
+		Shell_Quote(quoted[2], sizeof(quoted[2]), ProfileFile));
+
+	if (length < 0 || length >= (int)sizeof(command))
 	{
-		for (i = 0; i < N; i++)
+		return -1.0;
+	}
+
+	for (run = 0; run < TUNE_RUNS; run++)
+	{
+		pipe = popen(command, "r");
+		time = -1.0;
+
+		while (pipe != NULL && fgets(line, sizeof(line), pipe) != NULL)
 		{
-			for (j = 0; j < N; j++) 
-			{
-				if (i == j)
-				{
-					 // Diagonal dominance.
-					A[i][j] = (double)(rand() % maxnum) + 5.0;
-				}
+			sscanf(line, "Execution time: %lf", &time);
+		}
 
-				else
-				{
-					A[i][j] = (double)(rand() % maxnum) + 1.0;
-				}
-			}
+		if (pipe == NULL || pclose(pipe) != 0)
+		{
+			return -1.0;
 		}
-    }
 
-    if (strcmp(Init, "fast") == 0) 
+		best = (best < 0.0 || (time > 0.0 && time < best)) ? time : best;
+	}
+
+	return best;
+}
+
+char* Shell_Quote(char* quoted, size_t size, char* text)
+{
+	size_t length = 0;
+
+	// 'text' with every ' written as '\'', nothing inside is interpreted.
+	// Too long for the buffer gives '', the run then fails.
+	quoted[length++] = '\'';
+
+	for (; *text != '\0' && length + 6 < size; text++)
 	{
-		for (i = 0; i < N; i++) 
+		if (*text == '\'')
 		{
-			for (j = 0; j < N; j++) 
-			{
-				if (i == j)
-				{
-					// Diagonal dominance.
-					A[i][j] = 5.0;
-				}
+			memcpy(&quoted[length], "'\\''", 4);
+			length += 4;
+		}
 
-				else
-				{
-					A[i][j] = 2.0;
-				}
-			}
+		else
+		{
+			quoted[length++] = *text;
 		}
-    }
+	}
 
-    // Initialize vectors b and y.
-    for (i = 0; i < N; i++) 
+	if (*text != '\0')
 	{
-		b[i] = 2.0;
-		y[i] = 1.0;
-    }
+		length = 1;
+	}
 
-    printf("Done!\n\n");
+	quoted[length++] = '\'';
+	quoted[length] = '\0';
+
+	return quoted;
+}
 
-    if (PRINT == 1)
+double Initial_Value(int g, int j)
+{
+	// Element (g, j) of the "rand" or "fast" matrix, diagonally dominant.
+	if (strcmp(Init, "fast") == 0)
 	{
-		printf("===== BEFORE GUASSIAN ELIMINATION =====\n");
-		Print_Matrix();
+		return (g == j) ? 5.0 : 2.0;
 	}
+
+	return (double)(Gauss_Random(seed, g, j) % maxnum) + ((g == j) ? 5.0 : 1.0);
 }
 
 void Print_Matrix()
 {
-    int i, j;
+    int i;
  
-    printf("\nMatrix A:\n");
-
-    for (i = 0; i < N; i++) 
+	if (AB != NULL)
 	{
-		printf("[");
+		// Band storage, columns i - KL .. i + KU of each row.
+		printf("\nBand of A (%d lower, %d upper):\n", KL, KU);
 
-		for (j = 0; j < N; j++)
+		for (i = 0; i < N; i++) 
 		{
-			printf(" %5.2f,", A[i][j]);
+			Print_Values(AB[i], KL + KU + 1);
 		}
+	}
 
-		printf("]\n");
-    }
+	else if (oocBuffer != NULL)
+	{
+		printf("\nMatrix A is in %s.\n", OocFile);
+	}
 
-    printf("\nVector b:\n[");
+	else if (spRowPtr != NULL)
+	{
+		printf("\nMatrix A is sparse, %d nonzeros.\n", spNnz);
+	}
 
-    for (j = 0; j < N; j++)
+	else
 	{
-		printf(" %5.2f,", b[j]);
+	    printf("\nMatrix A:\n");
+
+	    for (i = 0; i < N; i++) 
+		{
+			Print_Values(A[i], N);
+	    }
 	}
 
-    printf("]\n");
-    printf("\nVector y:\n[");
+	Print_Flush();
+    printf("\nVector b:\n");
+	Print_Values(b, N);
+	Print_Flush();
+    printf("\nVector y:\n");
+	Print_Values(y, N);
+	Print_Flush();
+    printf("\nVector x:\n");
+	Print_Values(x, N);
+	Print_Flush();
 
-    for (j = 0; j < N; j++)
+	if (RHS > 0)
 	{
-		printf(" %5.2f,", y[j]);
+		printf("\nMatrix B (X after the block solve):\n");
+
+		for (i = 0; i < N; i++)
+		{
+			Print_Values(B[i], RHS);
+		}
+
+		Print_Flush();
 	}
 
-    printf("]\n");
     printf("\n");
 }
+
+void Print_Values(double* values, int count)
+{
+	int j, written;
+
+	// Format into the print buffer and write it out one chunk at a time,
+	// instead of a printf call per element.
+	if (printUsed >= PRINT_CHUNK)
+	{
+		Print_Flush();
+	}
+
+	printBuffer[printUsed++] = '[';
+
+	for (j = 0; j < count; j++)
+	{
+		written = snprintf(printBuffer + printUsed, 64, " %5.2f,", values[j]);
+		printUsed += (written < 64) ? written : 63;
+
+		if (printUsed >= PRINT_CHUNK)
+		{
+			Print_Flush();
+		}
+	}
+
+	printBuffer[printUsed++] = ']';
+	printBuffer[printUsed++] = '\n';
+}
+
+void Print_Flush()
+{
+	fflush(stdout);
+	fwrite(printBuffer, 1, printUsed, stdout);
+	fflush(stdout);
+	printUsed = 0;
+}
  
 void Read_Options(int argc, char **argv)
 {
@@ -276,9 +4889,35 @@ void Read_Options(int argc, char **argv)
 					printf("\nUsage: sor [-n problemsize]\n");
 					printf("           [-D] show default values \n");
 					printf("           [-h] help \n");
-					printf("           [-I init_type] fast/rand \n");
+					printf("           [-I init_type] fast/rand/band/sparse \n");
 					printf("           [-m maxnum] max random no \n");
+					printf("           [-s seed] seed of the random matrix \n");
 					printf("           [-P print_switch] 0/1 \n");
+					printf("           [-H huge_pages] 0 = off, 1 = transparent, 2 = hugetlbfs \n");
+					printf("           [-K kernel] fork/pipe/tile/band/rec/pool/ooc/sparse \n");
+					printf("           [-b tile_size] tile size of the tile kernel \n");
+					printf("           [-G rows] rows per block a thread owns in the fork kernel \n");
+					printf("           [-L keep_factors] 0/1 \n");
+					printf("           [-R right_hand_sides] solve a block of R right hand sides \n");
+					printf("           [-X mixed_precision] 0/1 \n");
+					printf("           [-w kl,ku] bandwidths of the band kernel, detected if not given \n");
+					printf("           [-f file] solve A and b from a binary matrix file \n");
+					printf("           [-F file] solve a sparse A from a Matrix Market file, b = 2 \n");
+					printf("           [-e ordering] nd/rcm/none, ordering of the sparse kernel \n");
+					printf("           [-W file] write the generated A and b to a binary matrix file \n");
+					printf("           [-o file] write the solution x to a binary file \n");
+					printf("           [-V verify] 0/1 \n");
+					printf("           [-t threads] number of threads, 0 = online CPUs \n");
+					printf("           [-p pinning] none/compact/scatter \n");
+					printf("           [-S smt] 0 = leave SMT siblings unused, 1 = use them \n");
+					printf("           [-T file] trace the fork kernel, Chrome trace JSON to file \n");
+					printf("           [-C steps] checkpoint the fork kernel every steps pivots \n");
+					printf("           [-c name] checkpoint files name.0 and name.1 \n");
+					printf("           [-r restart] 0/1, resume from the newest checkpoint \n");
+					printf("           [-O file] panel file of the out-of-core kernel \n");
+					printf("           [-M panels] panels of the out-of-core kernel in memory \n");
+					printf("           [-A tune] 0/1, calibrate kernel, threads and tile size and save them \n");
+					printf("           [-a file] tuned profile, default ~/.gauss_profile \n");
 					exit(0);
 				break;
 
@@ -286,7 +4925,13 @@ void Read_Options(int argc, char **argv)
 					printf("\nDefault:  n         = %d ", N);
 					printf("\n          Init      = rand" );
 					printf("\n          maxnum    = 5 ");
-					printf("\n          P         = 0 \n\n");
+					printf("\n          P         = 0 ");
+					printf("\n          H         = 0 ");
+					printf("\n          K         = fork ");
+					printf("\n          b         = %d ", TILE_SIZE);
+					printf("\n          L         = 0 ");
+					printf("\n          R         = 0 ");
+					printf("\n          X         = 0 \n\n");
 					exit(0);
 				break;
 
@@ -300,11 +4945,151 @@ void Read_Options(int argc, char **argv)
 					maxnum = atoi(*++argv);
 				break;
 
+				case 's':
+					--argc;
+					seed = strtoull(*++argv, NULL, 10);
+				break;
+
 				case 'P':
 					--argc;
 					PRINT = atoi(*++argv);
 				break;
 
+				case 'H':
+					--argc;
+					HUGE = atoi(*++argv);
+				break;
+
+				case 'K':
+					--argc;
+					Kernel = *++argv;
+				break;
+
+				case 'b':
+					--argc;
+					tileSize = atoi(*++argv);
+				break;
+
+				case 'G':
+					--argc;
+					CHUNK = atoi(*++argv);
+				break;
+
+				case 'L':
+					--argc;
+					KEEP_L = atoi(*++argv);
+				break;
+
+				case 'R':
+					--argc;
+					RHS = atoi(*++argv);
+				break;
+
+				case 'X':
+					--argc;
+					MIXED = atoi(*++argv);
+				break;
+
+				case 'f':
+					--argc;
+					InFile = *++argv;
+				break;
+
+				case 'W':
+					--argc;
+					DumpFile = *++argv;
+				break;
+
+				case 'F':
+					--argc;
+					SparseFile = *++argv;
+				break;
+
+				case 'e':
+					--argc;
+					Ordering = *++argv;
+
+					if (strcmp(Ordering, "nd") != 0 && strcmp(Ordering, "rcm") != 0 && strcmp(Ordering, "none") != 0)
+					{
+						printf("Unknown ordering %s, use nd, rcm or none.\n", Ordering);
+						exit(1);
+					}
+				break;
+
+				case 'o':
+					--argc;
+					OutFile = *++argv;
+				break;
+
+				case 'T':
+					--argc;
+					TraceFile = *++argv;
+				break;
+
+				case 'C':
+					--argc;
+					CHECKPOINT = atoi(*++argv);
+				break;
+
+				case 'c':
+					--argc;
+					CheckpointFile = *++argv;
+				break;
+
+				case 'r':
+					--argc;
+					RESTART = atoi(*++argv);
+				break;
+
+				case 'O':
+					--argc;
+					OocFile = *++argv;
+				break;
+
+				case 'A':
+					--argc;
+					TUNE = atoi(*++argv);
+				break;
+
+				case 'a':
+					--argc;
+					ProfileFile = *++argv;
+				break;
+
+				case 'M':
+					--argc;
+					window = atoi(*++argv);
+				break;
+
+				case 'V':
+					--argc;
+					VERIFY = atoi(*++argv);
+				break;
+
+				case 't':
+					--argc;
+					THREADS = atoi(*++argv);
+				break;
+
+				case 'p':
+					--argc;
+					Pinning = *++argv;
+				break;
+
+				case 'S':
+					--argc;
+					SMT = atoi(*++argv);
+				break;
+
+				case 'w':
+					--argc;
+
+					if (sscanf(*++argv, "%d,%d", &KL, &KU) == 1)
+					{
+						KU = KL;
+					}
+				break;
+
 				default:
 					printf("%s: ignored option: -%s\n", prog, *argv);
 					printf("HELP: try %s -u \n\n", prog);
@@ -1,40 +1,68 @@
 //==================================================//
 //		    SEQUENTIAL GAUSSIAN ELIMINATION			//
 //==================================================//
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <sys/mman.h>
 #include <mpi.h>
+#include "GuassianSolver.h"
 
-#define MAX_SIZE 2048
+#define DEFAULT_SIZE 2048
 
-typedef double matrix[MAX_SIZE][MAX_SIZE];
+// Verification passes if the backward error is below VERIFY_SCALE * N * eps.
+#define VERIFY_SCALE 10.0
+
+// Matrix storage alignment, rows start on a cache line.
+#define ALIGNMENT 64
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
 int	N;					// Matrix size.
 int	maxnum;				// max number of element.
+unsigned long long seed;	// seed of the matrix generator.
 char *Init;			// matrix init type.
 int	PRINT;				// print switch.
-matrix A;				// matrix A.
-double b[MAX_SIZE];	// vector b.
-double y[MAX_SIZE];	// vector y.
+int HUGE;				// huge page switch, 0 = off, 1 = transparent, 2 = hugetlbfs.
+int VERIFY;				// verify switch, check the residual of x against a copy of A and b.
+double **A;				// matrix A (row pointers into A_data).
+double *A_data;			// aligned backing storage of A.
+size_t A_bytes;			// size of A_data in bytes.
+int A_mapped;			// 1 if A_data was mmap:ed.
+int stride;				// padded row length of A in doubles.
+double *b;				// vector b.
+double *y;				// vector y.
+double *x;				// solution vector x.
+double *A0;				// copy of the original A for the verification.
+double *b0;				// copy of the original b.
+Gauss_Context solver;	// the solve, run on this thread by GuassianSolver.
 
 void Work(void);
+void Back_Substitution(void);
+int Verify(void);
+void Allocate_Matrix(void);
+void Free_Matrix(void);
 void Init_Matrix(void);
 void Print_Matrix(void);
 void Read_Options(int, char **);
 
 void Init_Default()
 {
-    N = 2048;
+    N = DEFAULT_SIZE;
     Init = "rand";
     maxnum = 15.0;
+    seed = 1;
     PRINT = 0;
+    HUGE = 0;
+    VERIFY = 1;
 }
 
 int main(int argc, char **argv)
 {
 	MPI_Init(&argc, &argv);
-	double start_time, end_time;
-
-    int i;
+	double start_time, mid_time, end_time;
+	int i, failed = 0;
  
 	// Init default values.
     Init_Default();
@@ -42,15 +70,34 @@ int main(int argc, char **argv)
 	// Read arguments.
     Read_Options(argc, argv);
 
-	// Init the matrix.
+	// Allocate and init the matrix.
+	Allocate_Matrix();
     Init_Matrix();
 
+	if (VERIFY == 1)
+	{
+		// Keep the original A and b, the solve overwrites both.
+		A0 = malloc((size_t)N * stride * sizeof(double));
+		b0 = malloc(N * sizeof(double));
+
+		for (i = 0; i < N; i++)
+		{
+			memcpy(A0 + (size_t)i * stride, A[i], N * sizeof(double));
+			b0[i] = b[i];
+		}
+	}
+
 	// Start timer.
 	start_time = MPI_Wtime();
 
 	// Do guassian elimination.
     Work();
 
+	mid_time = MPI_Wtime();
+
+	// Solve the triangular system for x.
+	Back_Substitution();
+
 	// Stop timer.
 	end_time = MPI_Wtime();
 
@@ -61,38 +108,157 @@ int main(int argc, char **argv)
 		printf("=======================================\n\n");
 	}
 
-	double time_taken = (end_time - start_time);
+	double time_taken = (mid_time - start_time);
 	printf("Execution time: %f\n", time_taken);
+	printf("Back substitution time: %f\n", end_time - mid_time);
+	printf("Total solve time: %f\n", end_time - start_time);
+
+	if (VERIFY == 1)
+	{
+		failed = Verify();
+	}
+
+	Free_Matrix();
+	MPI_Finalize();
+
+	return failed;
 }
 
 void Work(void)
 {
-    int i, j, k;
+    // Gaussian elimination algorithm, Algo 8.4 from Grama, in place on A
+    // without a thread pool.
+	Gauss_Init(&solver, N, A_data, stride, b, y, x, NULL);
 
-    // Gaussian elimination algorithm, Algo 8.4 from Grama.
-    for (k = 0; k < N; k++) 
+	if (Gauss_Factor(&solver, NULL, 1) == GAUSS_ZERO_PIVOT)
 	{
-		for (j = k+1; j < N; j++)
+		printf("Zero pivot, A has no LU factorization without pivoting.\n");
+	}
+}
+
+void Back_Substitution(void)
+{
+	// After Work() A is unit upper triangular, solve A x = y bottom-up.
+	Gauss_Back(&solver);
+}
+
+int Verify(void)
+{
+	int i, j;
+	double sum, rowSum, rnorm = 0.0, anorm = 0.0, bnorm = 0.0, xnorm = 0.0, error, threshold;
+
+	// Normwise backward error ||b - A x|| / (||A|| ||x|| + ||b||) with the
+	// original A and b, the same check as the parallel program.
+	for (i = 0; i < N; i++)
+	{
+		sum = 0.0;
+		rowSum = 0.0;
+
+		for (j = 0; j < N; j++)
 		{
-			// Division step.
-			A[k][j] = A[k][j] / A[k][k]; 
+			sum += A0[(size_t)i * stride + j] * x[j];
+			rowSum += (A0[(size_t)i * stride + j] < 0.0) ? -A0[(size_t)i * stride + j] : A0[(size_t)i * stride + j];
 		}
 
-		y[k] = b[k] / A[k][k];
-		A[k][k] = 1.0;
+		sum = (b0[i] > sum) ? b0[i] - sum : sum - b0[i];
+		rnorm = (sum > rnorm || sum != sum) ? sum : rnorm;
+		anorm = (rowSum > anorm) ? rowSum : anorm;
+		bnorm = (b0[i] > bnorm) ? b0[i] : ((-b0[i] > bnorm) ? -b0[i] : bnorm);
+		xnorm = (x[i] > xnorm) ? x[i] : ((-x[i] > xnorm) ? -x[i] : xnorm);
+	}
+
+	error = rnorm / (anorm * xnorm + bnorm);
+	threshold = VERIFY_SCALE * N * DBL_EPSILON;
+
+	printf("Residual ||b - Ax||: %e\n", rnorm);
+	printf("Backward error: %e (threshold %e) %s\n", error, threshold,
+		(error <= threshold) ? "PASSED" : "FAILED");
+
+	free(A0);
+	free(b0);
+
+	// NaN fails too.
+	return !(error <= threshold);
+}
 
-		for (i = k+1; i < N; i++) 
+void Allocate_Matrix()
+{
+	int i;
+
+	// Padded rows, the same layout as the solver library.
+	stride = Gauss_Stride(N);
+
+	A_bytes = (size_t)N * stride * sizeof(double);
+	A_mapped = 0;
+
+	if (HUGE == 2)
+	{
+		// Explicit huge pages, needs pages reserved in /proc/sys/vm/nr_hugepages.
+		size_t bytes = (A_bytes + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+		A_data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+		if (A_data == MAP_FAILED)
 		{
-			for (j = k+1; j < N; j++)
-			{
-				// Elimination step.
-				A[i][j] = A[i][j] - A[i][k]*A[k][j]; 
-			}
+			printf("MAP_HUGETLB failed, using transparent huge pages.\n");
+			HUGE = 1;
+		}
 
-			b[i] = b[i] - A[i][k]*y[k];
-			A[i][k] = 0.0;
+		else
+		{
+			A_bytes = bytes;
+			A_mapped = 1;
 		}
-    }
+	}
+
+	if (!A_mapped)
+	{
+		size_t alignment = (HUGE == 1) ? HUGE_PAGE_SIZE : ALIGNMENT;
+
+		if (posix_memalign((void**)&A_data, alignment, A_bytes) != 0)
+		{
+			printf("Could not allocate %zu bytes for matrix A.\n", A_bytes);
+			exit(1);
+		}
+
+		if (HUGE == 1)
+		{
+			// Ask for transparent huge pages, ignored if THP is disabled.
+			madvise(A_data, A_bytes, MADV_HUGEPAGE);
+		}
+	}
+
+	A = malloc(N * sizeof(double*));
+
+	for (i = 0; i < N; i++)
+	{
+		A[i] = A_data + (size_t)i * stride;
+	}
+
+	if (posix_memalign((void**)&b, ALIGNMENT, N * sizeof(double)) != 0 ||
+		posix_memalign((void**)&y, ALIGNMENT, N * sizeof(double)) != 0 ||
+		posix_memalign((void**)&x, ALIGNMENT, N * sizeof(double)) != 0)
+	{
+		printf("Could not allocate vectors b, y and x.\n");
+		exit(1);
+	}
+}
+
+void Free_Matrix()
+{
+	if (A_mapped)
+	{
+		munmap(A_data, A_bytes);
+	}
+
+	else
+	{
+		free(A_data);
+	}
+
+	free(A);
+	free(b);
+	free(y);
+	free(x);
 }
 
 void Init_Matrix()
@@ -103,6 +269,9 @@ void Init_Matrix()
     printf("\nSize      = %dx%d ", N, N);
     printf("\nMaxnum    = %d \n", maxnum);
     printf("Init	  = %s \n", Init);
+    printf("Seed      = %llu \n", seed);
+    printf("Stride    = %d \n", stride);
+    printf("Huge      = %d \n", HUGE);
     printf("Initializing matrix...\n");
  
     if (strcmp(Init, "rand") == 0) 
@@ -114,12 +283,12 @@ void Init_Matrix()
 				if (i == j)
 				{
 					 // Diagonal dominance.
-					A[i][j] = (double)(rand() % maxnum) + 5.0;
+					A[i][j] = (double)(Gauss_Random(seed, i, j) % maxnum) + 5.0;
 				}
 
 				else
 				{
-					A[i][j] = (double)(rand() % maxnum) + 1.0;
+					A[i][j] = (double)(Gauss_Random(seed, i, j) % maxnum) + 1.0;
 				}
 			}
 		}
@@ -145,11 +314,12 @@ void Init_Matrix()
 		}
     }
 
-    // Initialize vectors b and y.
+    // Initialize vectors b, y and x.
     for (i = 0; i < N; i++) 
 	{
 		b[i] = 2.0;
 		y[i] = 1.0;
+		x[i] = 0.0;
     }
 
     printf("Done!\n\n");
@@ -194,6 +364,14 @@ void Print_Matrix()
 		printf(" %5.2f,", y[j]);
 	}
 
+    printf("]\n");
+    printf("\nVector x:\n[");
+
+    for (j = 0; j < N; j++)
+	{
+		printf(" %5.2f,", x[j]);
+	}
+
     printf("]\n");
     printf("\n");
 }
@@ -225,7 +403,10 @@ void Read_Options(int argc, char **argv)
 					printf("           [-h] help \n");
 					printf("           [-I init_type] fast/rand \n");
 					printf("           [-m maxnum] max random no \n");
+					printf("           [-s seed] seed of the random matrix \n");
 					printf("           [-P print_switch] 0/1 \n");
+					printf("           [-H huge_pages] 0 = off, 1 = transparent, 2 = hugetlbfs \n");
+					printf("           [-V verify] 0/1 \n");
 					exit(0);
 				break;
 
@@ -233,7 +414,8 @@ void Read_Options(int argc, char **argv)
 					printf("\nDefault:  n         = %d ", N);
 					printf("\n          Init      = rand" );
 					printf("\n          maxnum    = 5 ");
-					printf("\n          P         = 0 \n\n");
+					printf("\n          P         = 0 ");
+					printf("\n          H         = 0 \n\n");
 					exit(0);
 				break;
 
@@ -247,11 +429,26 @@ void Read_Options(int argc, char **argv)
 					maxnum = atoi(*++argv);
 				break;
 
+				case 's':
+					--argc;
+					seed = strtoull(*++argv, NULL, 10);
+				break;
+
 				case 'P':
 					--argc;
 					PRINT = atoi(*++argv);
 				break;
 
+				case 'H':
+					--argc;
+					HUGE = atoi(*++argv);
+				break;
+
+				case 'V':
+					--argc;
+					VERIFY = atoi(*++argv);
+				break;
+
 				default:
 					printf("%s: ignored option: -%s\n", prog, *argv);
 					printf("HELP: try %s -u \n\n", prog);
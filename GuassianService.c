@@ -0,0 +1,524 @@
+//==================================================//
+//		    GAUSSIAN SOLVE SERVICE					//
+//==================================================//
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "GuassianSolver.h"
+
+#define QUEUE_SIZE 64
+#define LINE_LENGTH 256
+
+// Largest n of a job, the padded row length must fit in an int.
+#define MAX_JOB_SIZE (INT_MAX / 2)
+
+// Rows per team member, a job of n rows asks for n / TEAM_GRAIN threads.
+#define TEAM_GRAIN 256
+
+// A linear system to solve, one line of the job source.
+typedef struct
+{
+	int id;
+	int n;
+	unsigned long long seed;
+	int threads;		// team size, 0 = chosen from n.
+	double arrival;		// queued.
+	double start;		// taken by a dispatcher.
+	double finish;		// solved.
+	Gauss_Context context;
+} Job;
+
+// Bounded job queue, producers wait while it is full and dispatchers while
+// it is empty. Closed when the job source ends.
+typedef struct
+{
+	int in, out;
+	int no_elems;
+	int closed;
+	Job **buf;
+	pthread_mutex_t lock;
+	pthread_cond_t notFull;
+	pthread_cond_t notEmpty;
+} Job_Queue;
+
+int cores;				// workers of the solver pool.
+int dispatchers;		// jobs in flight.
+int queueSize;			// capacity of the job queue.
+int grain;				// rows per team member.
+int maxnum;				// max number of element.
+int PRINT;				// print a line per job.
+char *JobFile;			// job source, NULL = stdin.
+
+Gauss_Pool *pool;
+Job_Queue queue;
+
+// Results, guarded by statsLock.
+double *latencies;
+int jobsDone;
+int jobsFailed;
+int jobsRejected;		// malformed job lines, only counted by main().
+int latencyCapacity;
+double solveTime;		// sum of the factor and back substitution times.
+double waitTime;		// sum of the time jobs spent queued.
+pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+
+void Queue_Init(int);
+void Queue_Push(Job*);
+Job* Queue_Pop(void);
+void Queue_Close(void);
+void* Dispatcher(void*);
+int Parse_Job(char*, Job*);
+int Team_Size(int);
+void Init_Job(Job*);
+void Record(Job*);
+int Compare_Doubles(const void*, const void*);
+void Report(double);
+double Now(void);
+void Read_Options(int, char **);
+
+void Init_Default()
+{
+	cores = sysconf(_SC_NPROCESSORS_ONLN);
+	dispatchers = 0;
+	queueSize = QUEUE_SIZE;
+	grain = TEAM_GRAIN;
+	maxnum = 15;
+	PRINT = 0;
+	JobFile = NULL;
+}
+
+int main(int argc, char **argv)
+{
+	char line[LINE_LENGTH];
+	pthread_t *threads;
+	FILE *source = stdin;
+	double start_time;
+	Job *job;
+	int i, id = 0, number = 0;
+
+	// Init default values.
+	Init_Default();
+
+	// Read arguments.
+	Read_Options(argc, argv);
+
+	if (dispatchers <= 0)
+	{
+		// Enough jobs in flight to give every core a small job.
+		dispatchers = cores;
+	}
+
+	if (JobFile != NULL)
+	{
+		source = fopen(JobFile, "r");
+
+		if (source == NULL)
+		{
+			perror(JobFile);
+			exit(1);
+		}
+	}
+
+	printf("Cores       = %d \n", cores);
+	printf("Dispatchers = %d \n", dispatchers);
+	printf("Queue size  = %d \n", queueSize);
+	printf("Team grain  = %d rows per thread \n", grain);
+
+	pool = Gauss_Pool_Create(cores);
+
+	if (pool == NULL)
+	{
+		printf("Could not start %d solver workers.\n", cores);
+		exit(1);
+	}
+
+	Queue_Init(queueSize);
+	threads = malloc(dispatchers * sizeof(pthread_t));
+
+	if (threads == NULL)
+	{
+		printf("Could not allocate %d dispatchers.\n", dispatchers);
+		exit(1);
+	}
+
+	start_time = Now();
+
+	for (i = 0; i < dispatchers; i++)
+	{
+		pthread_create(&threads[i], NULL, Dispatcher, NULL);
+	}
+
+	// One job per line, "n [seed] [threads]", # starts a comment.
+	while (fgets(line, sizeof(line), source) != NULL)
+	{
+		number++;
+		i = strspn(line, " \t\r\n");
+
+		if (line[i] == '#' || line[i] == '\0')
+		{
+			continue;
+		}
+
+		job = calloc(1, sizeof(Job));
+
+		if (job == NULL)
+		{
+			printf("Could not allocate job %d.\n", id);
+			exit(1);
+		}
+
+		if (Parse_Job(line, job) != 0)
+		{
+			fprintf(stderr, "Line %d: bad job, expected \"n [seed] [threads]\" with n >= 1: %s", number, line);
+			jobsRejected++;
+			free(job);
+			continue;
+		}
+
+		job->id = id++;
+		job->arrival = Now();
+		Queue_Push(job);
+	}
+
+	// No more jobs, the dispatchers drain the queue and exit.
+	Queue_Close();
+
+	for (i = 0; i < dispatchers; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	Report(Now() - start_time);
+
+	Gauss_Pool_Destroy(pool);
+	free(threads);
+	free(queue.buf);
+	free(latencies);
+
+	if (source != stdin)
+	{
+		fclose(source);
+	}
+
+	return jobsFailed > 0 || jobsRejected > 0;
+}
+
+int Parse_Job(char* line, Job* job)
+{
+	char *end;
+	long value;
+
+	// "n [seed] [threads]" and nothing else, 0 if the line is a valid job.
+	job->seed = 1;
+	job->threads = 0;
+	value = strtol(line, &end, 10);
+
+	if (end == line || value < 1 || value > MAX_JOB_SIZE)
+	{
+		return -1;
+	}
+
+	job->n = value;
+	line = end + strspn(end, " \t");
+
+	if (*line >= '0' && *line <= '9')
+	{
+		job->seed = strtoull(line, &end, 10);
+		line = end + strspn(end, " \t");
+
+		if (*line >= '0' && *line <= '9')
+		{
+			value = strtol(line, &end, 10);
+
+			if (value > INT_MAX)
+			{
+				return -1;
+			}
+
+			job->threads = value;
+			line = end;
+		}
+	}
+
+	return (line[strspn(line, " \t\r\n")] == '\0') ? 0 : -1;
+}
+
+void Queue_Init(int size)
+{
+	queue.in = 0;
+	queue.out = 0;
+	queue.no_elems = 0;
+	queue.closed = 0;
+	queue.buf = malloc(size * sizeof(Job*));
+
+	if (queue.buf == NULL)
+	{
+		printf("Could not allocate a queue of %d jobs.\n", size);
+		exit(1);
+	}
+
+	pthread_mutex_init(&queue.lock, NULL);
+	pthread_cond_init(&queue.notFull, NULL);
+	pthread_cond_init(&queue.notEmpty, NULL);
+}
+
+void Queue_Push(Job* job)
+{
+	pthread_mutex_lock(&queue.lock);
+
+	// A full queue holds back the source.
+	while (queue.no_elems == queueSize)
+	{
+		pthread_cond_wait(&queue.notFull, &queue.lock);
+	}
+
+	queue.buf[queue.in] = job;
+	queue.in = (queue.in + 1) % queueSize;
+	queue.no_elems++;
+
+	pthread_cond_signal(&queue.notEmpty);
+	pthread_mutex_unlock(&queue.lock);
+}
+
+Job* Queue_Pop(void)
+{
+	Job *job = NULL;
+
+	pthread_mutex_lock(&queue.lock);
+
+	while (queue.no_elems == 0 && !queue.closed)
+	{
+		pthread_cond_wait(&queue.notEmpty, &queue.lock);
+	}
+
+	// NULL once the queue is closed and empty.
+	if (queue.no_elems > 0)
+	{
+		job = queue.buf[queue.out];
+		queue.out = (queue.out + 1) % queueSize;
+		queue.no_elems--;
+		pthread_cond_signal(&queue.notFull);
+	}
+
+	pthread_mutex_unlock(&queue.lock);
+
+	return job;
+}
+
+void Queue_Close(void)
+{
+	pthread_mutex_lock(&queue.lock);
+	queue.closed = 1;
+	pthread_cond_broadcast(&queue.notEmpty);
+	pthread_mutex_unlock(&queue.lock);
+}
+
+void* Dispatcher(void* input)
+{
+	Job *job;
+
+	while ((job = Queue_Pop()) != NULL)
+	{
+		job->start = Now();
+
+		if (Gauss_Init(&job->context, job->n, NULL, 0, NULL, NULL, NULL, NULL) != GAUSS_OK)
+		{
+			job->context.status = GAUSS_NO_MEMORY;
+		}
+
+		else
+		{
+			Init_Job(job);
+			Gauss_Solve(&job->context, pool, job->threads > 0 ? job->threads : Team_Size(job->n));
+		}
+
+		job->finish = Now();
+		Record(job);
+		Gauss_Free(&job->context);
+		free(job);
+	}
+
+	return NULL;
+}
+
+int Team_Size(int n)
+{
+	int team = n / grain;
+
+	// Small jobs run one per core, large ones get a share of the cores that
+	// grows with n, so both kinds keep the pool busy at the same time.
+	if (team < 1)
+	{
+		team = 1;
+	}
+
+	return (team > cores) ? cores : team;
+}
+
+void Init_Job(Job* job)
+{
+	int i, j, n = job->n;
+	double *row;
+
+	// The "rand" matrix of the solver programs for this seed, b = 2.
+	for (i = 0; i < n; i++)
+	{
+		row = job->context.A + (size_t)i * job->context.stride;
+
+		for (j = 0; j < n; j++)
+		{
+			row[j] = (double)(Gauss_Random(job->seed, i, j) % maxnum) + ((i == j) ? 5.0 : 1.0);
+		}
+
+		job->context.b[i] = 2.0;
+	}
+}
+
+void Record(Job* job)
+{
+	double *grown;
+
+	pthread_mutex_lock(&statsLock);
+
+	if (jobsDone == latencyCapacity)
+	{
+		grown = realloc(latencies, (latencyCapacity == 0 ? 1024 : 2 * latencyCapacity) * sizeof(double));
+
+		if (grown == NULL)
+		{
+			printf("Could not record the latency of job %d.\n", job->id);
+			exit(1);
+		}
+
+		latencyCapacity = (latencyCapacity == 0) ? 1024 : 2 * latencyCapacity;
+		latencies = grown;
+	}
+
+	latencies[jobsDone++] = job->finish - job->arrival;
+	waitTime += job->start - job->arrival;
+	solveTime += job->context.factorTime + job->context.backTime;
+
+	if (job->context.status != GAUSS_OK)
+	{
+		jobsFailed++;
+	}
+
+	if (PRINT == 1)
+	{
+		printf("Job %d: n = %d, team %d, %s, latency %f, solve %f\n", job->id, job->n, job->context.team,
+			(job->context.status == GAUSS_OK) ? "solved" : "failed",
+			job->finish - job->arrival, job->context.factorTime + job->context.backTime);
+	}
+
+	pthread_mutex_unlock(&statsLock);
+}
+
+int Compare_Doubles(const void* left, const void* right)
+{
+	double a = *(const double*) left, b = *(const double*) right;
+
+	return (a > b) - (a < b);
+}
+
+void Report(double time_taken)
+{
+	if (jobsDone == 0)
+	{
+		printf("No jobs (%d rejected).\n", jobsRejected);
+		return;
+	}
+
+	qsort(latencies, jobsDone, sizeof(double), Compare_Doubles);
+
+	// Nearest rank percentiles of the arrival to finish latency.
+	printf("Jobs: %d (%d failed, %d rejected)\n", jobsDone, jobsFailed, jobsRejected);
+	printf("Execution time: %f\n", time_taken);
+	printf("Jobs/sec: %.2f\n", jobsDone / time_taken);
+	printf("Latency p50: %f\n", latencies[(jobsDone - 1) * 50 / 100]);
+	printf("Latency p90: %f\n", latencies[(jobsDone - 1) * 90 / 100]);
+	printf("Latency p99: %f\n", latencies[(jobsDone - 1) * 99 / 100]);
+	printf("Latency max: %f\n", latencies[jobsDone - 1]);
+	printf("Mean queue wait: %f\n", waitTime / jobsDone);
+	printf("Mean solve time: %f\n", solveTime / jobsDone);
+}
+
+double Now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void Read_Options(int argc, char **argv)
+{
+	while (++argv, --argc > 0)
+	{
+		if (**argv == '-')
+		{
+			switch ( *++*argv )
+			{
+				case 'c':
+					--argc;
+					cores = atoi(*++argv);
+					cores = (cores < 1) ? 1 : cores;
+				break;
+
+				case 'j':
+					--argc;
+					dispatchers = atoi(*++argv);
+				break;
+
+				case 'q':
+					--argc;
+					queueSize = atoi(*++argv);
+					queueSize = (queueSize < 1) ? 1 : queueSize;
+				break;
+
+				case 'g':
+					--argc;
+					grain = atoi(*++argv);
+					grain = (grain < 1) ? 1 : grain;
+				break;
+
+				case 'm':
+					--argc;
+					maxnum = atoi(*++argv);
+				break;
+
+				case 'f':
+					--argc;
+					JobFile = *++argv;
+				break;
+
+				case 'P':
+					--argc;
+					PRINT = atoi(*++argv);
+				break;
+
+				case 'h':
+				case 'u':
+					printf("\nUsage: service [-f jobs] job file or pipe, default stdin \n");
+					printf("           [-c cores] workers of the solver pool \n");
+					printf("           [-j jobs] jobs in flight, 0 = cores \n");
+					printf("           [-q size] capacity of the job queue \n");
+					printf("           [-g rows] rows per thread of a job's team \n");
+					printf("           [-m maxnum] max random no \n");
+					printf("           [-P print_switch] 0/1, a line per job \n");
+					exit(0);
+				break;
+
+				default:
+					printf("%s: ignored option: -%s\n", "service", *argv);
+					printf("HELP: try %s -u \n\n", "service");
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,494 @@
+//==================================================//
+//		    GAUSSIAN SOLVER LIBRARY					//
+//==================================================//
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "GuassianSolver.h"
+
+// Storage alignment, rows start on a cache line.
+#define ALIGNMENT 64
+
+struct Gauss_Pool
+{
+	pthread_t *workers;
+	int size;				// Number of workers.
+	int idle;				// Workers not reserved by a team.
+	int shutdown;
+	Gauss_Context *waiting;	// Solves waiting for a team, oldest first.
+	Gauss_Context *granted;	// Solves with team slots left to claim.
+	pthread_mutex_t lock;
+	pthread_cond_t work;	// Signalled when a team is granted.
+	pthread_cond_t done;	// Broadcast when a team finishes.
+};
+
+// Internal, not part of the API.
+static void* Pool_Worker(void*);
+static void Pool_Dispatch(Gauss_Pool*);
+static void Team_Work(Gauss_Context*, int);
+static void Normalize(Gauss_Context*, int);
+static double Now(void);
+
+int Gauss_Arena_Init(Gauss_Arena* arena, size_t bytes)
+{
+	arena->size = (bytes + ALIGNMENT - 1) & ~((size_t)ALIGNMENT - 1);
+	arena->used = 0;
+	arena->data = aligned_alloc(ALIGNMENT, arena->size);
+	pthread_mutex_init(&arena->lock, NULL);
+
+	return (arena->data == NULL) ? GAUSS_NO_MEMORY : GAUSS_OK;
+}
+
+void* Gauss_Arena_Alloc(Gauss_Arena* arena, size_t bytes)
+{
+	void *block = NULL;
+
+	bytes = (bytes + ALIGNMENT - 1) & ~((size_t)ALIGNMENT - 1);
+	pthread_mutex_lock(&arena->lock);
+
+	if (arena->used + bytes <= arena->size)
+	{
+		block = arena->data + arena->used;
+		arena->used += bytes;
+	}
+
+	pthread_mutex_unlock(&arena->lock);
+
+	return block;
+}
+
+void Gauss_Arena_Reset(Gauss_Arena* arena)
+{
+	// Every block of the arena is released at once.
+	pthread_mutex_lock(&arena->lock);
+	arena->used = 0;
+	pthread_mutex_unlock(&arena->lock);
+}
+
+void Gauss_Arena_Free(Gauss_Arena* arena)
+{
+	free(arena->data);
+	pthread_mutex_destroy(&arena->lock);
+	arena->data = NULL;
+	arena->size = 0;
+	arena->used = 0;
+}
+
+Gauss_Pool* Gauss_Pool_Create(int workers)
+{
+	int i;
+	Gauss_Pool *pool = calloc(1, sizeof(Gauss_Pool));
+
+	if (pool == NULL)
+	{
+		return NULL;
+	}
+
+	pool->size = (workers < 1) ? 1 : workers;
+	pool->idle = pool->size;
+	pool->workers = malloc(pool->size * sizeof(pthread_t));
+
+	if (pool->workers == NULL)
+	{
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	for (i = 0; i < pool->size; i++)
+	{
+		if (pthread_create(&pool->workers[i], NULL, Pool_Worker, (void*)pool) != 0)
+		{
+			// Stop the workers started so far, NULL like a failed allocation.
+			pool->size = i;
+			Gauss_Pool_Destroy(pool);
+			return NULL;
+		}
+	}
+
+	return pool;
+}
+
+void Gauss_Pool_Destroy(Gauss_Pool* pool)
+{
+	int i;
+
+	// Solves still queued are not run, the callers must have returned.
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->size; i++)
+	{
+		pthread_join(pool->workers[i], NULL);
+	}
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->done);
+	free(pool->workers);
+	free(pool);
+}
+
+static void Pool_Dispatch(Gauss_Pool* pool)
+{
+	Gauss_Context *context, **link, **last;
+
+	// Grant teams in arrival order. When the oldest solve does not fit, later
+	// ones that fit in the idle workers start ahead of it (backfill), until it
+	// has been passed GAUSS_MAX_BYPASS times, so a large solve cannot starve.
+	// Called with the lock held.
+	link = &pool->waiting;
+
+	while (*link != NULL && pool->idle > 0)
+	{
+		context = *link;
+
+		if (context->team > pool->idle)
+		{
+			if (link == &pool->waiting && context->bypassed >= GAUSS_MAX_BYPASS)
+			{
+				break;
+			}
+
+			link = &context->next;
+			continue;
+		}
+
+		if (link != &pool->waiting)
+		{
+			pool->waiting->bypassed++;
+		}
+
+		*link = context->next;
+		pool->idle -= context->team;
+		context->next = NULL;
+
+		for (last = &pool->granted; *last != NULL; last = &(*last)->next)
+		{
+		}
+
+		*last = context;
+		pthread_cond_broadcast(&pool->work);
+
+		// The head may fit now, or its bypass budget may be spent.
+		link = &pool->waiting;
+	}
+}
+
+static void* Pool_Worker(void* input)
+{
+	Gauss_Pool *pool = (Gauss_Pool*) input;
+	Gauss_Context *context;
+	int id;
+
+	pthread_mutex_lock(&pool->lock);
+
+	while (1)
+	{
+		while (pool->granted == NULL && !pool->shutdown)
+		{
+			pthread_cond_wait(&pool->work, &pool->lock);
+		}
+
+		if (pool->granted == NULL)
+		{
+			break;
+		}
+
+		// Claim the next slot of the oldest granted team.
+		context = pool->granted;
+		id = context->claimed++;
+
+		if (context->claimed == context->team)
+		{
+			pool->granted = context->next;
+		}
+
+		pthread_mutex_unlock(&pool->lock);
+		Team_Work(context, id);
+		pthread_mutex_lock(&pool->lock);
+
+		pool->idle++;
+
+		if (++context->finished == context->team)
+		{
+			pthread_cond_broadcast(&pool->done);
+		}
+
+		Pool_Dispatch(pool);
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+int Gauss_Stride(int n)
+{
+	int stride;
+
+	// Pad rows to whole cache lines, and keep the stride an odd number of
+	// lines so consecutive rows never alias into the same cache sets.
+	stride = (n + 7) & ~7;
+
+	if ((stride / 8) % 2 == 0)
+	{
+		stride += 8;
+	}
+
+	return stride;
+}
+
+unsigned long long Gauss_Random(unsigned long long seed, unsigned long long i, unsigned long long j)
+{
+	// Counter based generator, a splitmix64 hash of (seed, i, j). Element
+	// (i, j) gets the same value whichever thread, rank or program computes
+	// it, so every program builds the same matrix for a seed.
+	unsigned long long z = seed * 0x9E3779B97F4A7C15ULL + ((i << 32) | j);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z = (z ^ (z >> 31)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+	return z ^ (z >> 31);
+}
+
+int Gauss_Init(Gauss_Context* context, int n, double* A, int stride, double* b, double* y, double* x, Gauss_Arena* arena)
+{
+	double **vectors[4];
+	size_t bytes[4];
+	int i;
+
+	memset(context, 0, sizeof(Gauss_Context));
+	context->n = n;
+	context->A = A;
+	context->stride = (A != NULL) ? stride : Gauss_Stride(n);
+	context->b = b;
+	context->y = y;
+	context->x = x;
+
+	// Whatever the caller did not provide comes from the arena, or from the
+	// heap (freed by Gauss_Free()) without one.
+	vectors[0] = &context->A;
+	vectors[1] = &context->b;
+	vectors[2] = &context->y;
+	vectors[3] = &context->x;
+	bytes[0] = (size_t)n * context->stride * sizeof(double);
+	bytes[1] = bytes[2] = bytes[3] = n * sizeof(double);
+
+	for (i = 0; i < 4; i++)
+	{
+		if (*vectors[i] != NULL)
+		{
+			continue;
+		}
+
+		if (arena != NULL)
+		{
+			*vectors[i] = Gauss_Arena_Alloc(arena, bytes[i]);
+		}
+
+		else
+		{
+			*vectors[i] = context->owned[i] = aligned_alloc(ALIGNMENT, (bytes[i] + ALIGNMENT - 1) & ~((size_t)ALIGNMENT - 1));
+		}
+
+		if (*vectors[i] == NULL)
+		{
+			Gauss_Free(context);
+			return GAUSS_NO_MEMORY;
+		}
+	}
+
+	return GAUSS_OK;
+}
+
+void Gauss_Free(Gauss_Context* context)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+	{
+		free(context->owned[i]);
+		context->owned[i] = NULL;
+	}
+}
+
+int Gauss_Factor(Gauss_Context* context, Gauss_Pool* pool, int threads)
+{
+	Gauss_Context **last;
+	double start_time = Now();
+
+	context->status = GAUSS_OK;
+	context->team = (pool == NULL || threads < 1) ? 1 : threads;
+
+	if (pool != NULL && context->team > pool->size)
+	{
+		context->team = pool->size;
+	}
+
+	if (pool == NULL)
+	{
+		// No pool, run on the caller.
+		Team_Work(context, 0);
+	}
+
+	else
+	{
+		// One thread teams go through the pool too, so the pool's workers
+		// are the only threads solving and the cores are not oversubscribed.
+		pthread_barrier_init(&context->barrier, NULL, context->team);
+		context->claimed = 0;
+		context->finished = 0;
+		context->bypassed = 0;
+		context->next = NULL;
+
+		// Queue the solve and wait for its team to finish.
+		pthread_mutex_lock(&pool->lock);
+
+		for (last = &pool->waiting; *last != NULL; last = &(*last)->next)
+		{
+		}
+
+		*last = context;
+		Pool_Dispatch(pool);
+
+		while (context->finished < context->team)
+		{
+			pthread_cond_wait(&pool->done, &pool->lock);
+		}
+
+		pthread_mutex_unlock(&pool->lock);
+		pthread_barrier_destroy(&context->barrier);
+	}
+
+	context->factorTime = Now() - start_time;
+
+	return context->status;
+}
+
+static void Team_Work(Gauss_Context* context, int id)
+{
+	int i, j, k, n = context->n, team = context->team;
+	double *A = context->A, *pivot, *row;
+	size_t stride = context->stride;
+
+	// Member t owns rows t, t + team, ... for the whole elimination. The
+	// owner of row k + 1 normalizes it right after its step k update, so a
+	// step needs one barrier.
+	if (id == 0)
+	{
+		Normalize(context, 0);
+	}
+
+	for (k = 0; k < n; k++)
+	{
+		if (team > 1)
+		{
+			pthread_barrier_wait(&context->barrier);
+		}
+
+		// Everyone reads the status after the same barrier.
+		if (context->status != GAUSS_OK)
+		{
+			return;
+		}
+
+		pivot = A + k * stride;
+
+		for (i = k + 1 + ((id - (k + 1)) % team + team) % team; i < n; i += team)
+		{
+			row = A + i * stride;
+
+			for (j = k+1; j < n; j++)
+			{
+				// Elimination step.
+				row[j] = row[j] - row[k] * pivot[j];
+			}
+
+			context->b[i] = context->b[i] - row[k] * context->y[k];
+
+			if (context->keepL == 0)
+			{
+				row[k] = 0.0;
+			}
+		}
+
+		if (k + 1 < n && (k + 1) % team == id)
+		{
+			Normalize(context, k + 1);
+		}
+	}
+}
+
+static void Normalize(Gauss_Context* context, int k)
+{
+	int j;
+	double *row = context->A + (size_t)k * context->stride;
+
+	if (row[k] == 0.0)
+	{
+		context->status = GAUSS_ZERO_PIVOT;
+		return;
+	}
+
+	for (j = k+1; j < context->n; j++)
+	{
+		// Division step.
+		row[j] = row[j] / row[k];
+	}
+
+	context->y[k] = context->b[k] / row[k];
+
+	if (context->keepL == 0)
+	{
+		row[k] = 1.0;
+	}
+}
+
+void Gauss_Back(Gauss_Context* context)
+{
+	int i, j, n = context->n;
+	double *row, *x = context->x, start_time = Now();
+
+	// After the elimination U is unit upper triangular (the pivots sit in L
+	// with keepL), solve U x = y bottom-up.
+	for (i = n - 1; i >= 0; i--)
+	{
+		row = context->A + (size_t)i * context->stride;
+		x[i] = context->y[i];
+
+		for (j = i + 1; j < n; j++)
+		{
+			x[i] = x[i] - row[j] * x[j];
+		}
+	}
+
+	context->backTime = Now() - start_time;
+}
+
+int Gauss_Solve(Gauss_Context* context, Gauss_Pool* pool, int threads)
+{
+	if (Gauss_Factor(context, pool, threads) == GAUSS_OK)
+	{
+		Gauss_Back(context);
+	}
+
+	return context->status;
+}
+
+static double Now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
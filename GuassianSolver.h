@@ -0,0 +1,74 @@
+//==================================================//
+//		    GAUSSIAN SOLVER LIBRARY					//
+//==================================================//
+#ifndef GUASSIAN_SOLVER_H
+#define GUASSIAN_SOLVER_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Return values of Gauss_Init(), Gauss_Factor() and Gauss_Solve().
+#define GAUSS_OK 0
+#define GAUSS_ZERO_PIVOT 1		// A has no LU factorization without pivoting.
+#define GAUSS_NO_MEMORY 2
+
+// Bump allocator for the matrices of many solves, one free for all of them.
+typedef struct
+{
+	char *data;
+	size_t size;
+	size_t used;
+	pthread_mutex_t lock;	// Solves on several threads may share an arena.
+} Gauss_Arena;
+
+// Workers shared by all solves of a process. A solve asking for t threads
+// runs as a team of t workers that starts only when t workers are idle, so
+// the team's per-step barriers never wait on a worker that is busy elsewhere.
+// While the oldest solve waits for enough idle workers, smaller solves that
+// fit may start ahead of it, at most GAUSS_MAX_BYPASS times.
+// Gauss_Pool_Create() returns NULL if the pool or its workers cannot be made.
+#define GAUSS_MAX_BYPASS 16
+
+typedef struct Gauss_Pool Gauss_Pool;
+
+// One linear system A x = b, everything a solve touches lives here.
+typedef struct Gauss_Context
+{
+	int n;				// Size of the system.
+	int stride;			// Row length of A in doubles.
+	double *A;			// Row major, overwritten with U (and L with keepL).
+	double *b;			// Right hand side, overwritten.
+	double *y;			// b after the elimination, U x = y.
+	double *x;			// Solution.
+	int keepL;			// Keep the multipliers, A holds L (with pivots) and U.
+	int status;			// GAUSS_OK or GAUSS_ZERO_PIVOT after Gauss_Factor().
+	double factorTime;	// Seconds of the elimination.
+	double backTime;	// Seconds of the back substitution.
+
+	// Owned storage and the team running the solve.
+	void *owned[4];
+	int team;
+	int claimed;
+	int finished;
+	int bypassed;		// Solves started ahead of this one.
+	pthread_barrier_t barrier;
+	struct Gauss_Context *next;
+} Gauss_Context;
+
+int Gauss_Arena_Init(Gauss_Arena*, size_t);
+void* Gauss_Arena_Alloc(Gauss_Arena*, size_t);
+void Gauss_Arena_Reset(Gauss_Arena*);
+void Gauss_Arena_Free(Gauss_Arena*);
+
+Gauss_Pool* Gauss_Pool_Create(int);
+void Gauss_Pool_Destroy(Gauss_Pool*);
+
+int Gauss_Init(Gauss_Context*, int, double*, int, double*, double*, double*, Gauss_Arena*);
+int Gauss_Factor(Gauss_Context*, Gauss_Pool*, int);
+void Gauss_Back(Gauss_Context*);
+int Gauss_Solve(Gauss_Context*, Gauss_Pool*, int);
+void Gauss_Free(Gauss_Context*);
+int Gauss_Stride(int);
+unsigned long long Gauss_Random(unsigned long long, unsigned long long, unsigned long long);
+
+#endif
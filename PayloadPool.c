@@ -0,0 +1,130 @@
+//==================================================//
+//			  BUFFER PAYLOAD POOL					//
+//==================================================//
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "PayloadPool.h"
+
+// First cache line of a slab, the owner of its objects.
+typedef struct
+{
+	Payload_Pool *owner;
+} Slab_Header;
+
+int Payload_Pool_Init(Payload_Pool* pool, size_t objectSize)
+{
+	pool->objectSize = (objectSize + CACHE_LINE - 1) & ~((size_t)CACHE_LINE - 1);
+	pool->objectSize = (pool->objectSize == 0) ? CACHE_LINE : pool->objectSize;
+	pool->slabs = NULL;
+	pool->slabCount = 0;
+
+	// An object has to fit in a slab after its header.
+	if (pool->objectSize > SLAB_SIZE - CACHE_LINE)
+	{
+		return -1;
+	}
+
+	pool->local = NULL;
+	pool->fresh = NULL;
+	pool->freshEnd = NULL;
+	pool->slabCapacity = 16;
+	pool->slabs = malloc(pool->slabCapacity * sizeof(char*));
+	pool->hits = 0;
+	pool->misses = 0;
+	pool->footprint = 0;
+	pool->returned = NULL;
+
+	return (pool->slabs == NULL) ? -1 : 0;
+}
+
+void* Payload_Alloc(Payload_Pool* pool)
+{
+	Payload_Object *object;
+	char *slab, **slabs;
+
+	if (pool->local == NULL)
+	{
+		// Take everything the consumers returned so far in one exchange, the
+		// list is never popped one by one so there is no ABA problem.
+		pool->local = __atomic_exchange_n(&pool->returned, NULL, __ATOMIC_ACQUIRE);
+	}
+
+	if (pool->local != NULL)
+	{
+		object = pool->local;
+		pool->local = object->next;
+		pool->hits++;
+		return object;
+	}
+
+	// No slab yet or no room left in the current one.
+	if (pool->fresh == NULL || (size_t)(pool->freshEnd - pool->fresh) < pool->objectSize)
+	{
+		// New slab, tagged with its owner.
+		slab = aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+
+		if (slab == NULL)
+		{
+			printf("Could not allocate a payload slab.\n");
+			exit(1);
+		}
+
+		if (pool->slabCount == pool->slabCapacity)
+		{
+			slabs = realloc(pool->slabs, 2 * pool->slabCapacity * sizeof(char*));
+
+			if (slabs == NULL)
+			{
+				printf("Could not grow the payload slab list.\n");
+				exit(1);
+			}
+
+			pool->slabs = slabs;
+			pool->slabCapacity *= 2;
+		}
+
+		((Slab_Header*)slab)->owner = pool;
+		pool->slabs[pool->slabCount++] = slab;
+		pool->footprint += SLAB_SIZE;
+		pool->fresh = slab + CACHE_LINE;
+		pool->freshEnd = slab + SLAB_SIZE;
+	}
+
+	object = (Payload_Object*)pool->fresh;
+	pool->fresh += pool->objectSize;
+	pool->misses++;
+
+	return object;
+}
+
+void Payload_Free(void* pointer)
+{
+	Payload_Object *object = pointer;
+	Slab_Header *slab = (Slab_Header*)((size_t)pointer & ~((size_t)SLAB_SIZE - 1));
+	Payload_Pool *pool = slab->owner;
+
+	// Lock-free push on the owner's return list.
+	object->next = __atomic_load_n(&pool->returned, __ATOMIC_RELAXED);
+
+	while (!__atomic_compare_exchange_n(&pool->returned, &object->next, object, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	{
+	}
+}
+
+void Payload_Pool_Destroy(Payload_Pool* pool)
+{
+	int i;
+
+	// Objects still in flight are released with their slabs.
+	for (i = 0; i < pool->slabCount; i++)
+	{
+		free(pool->slabs[i]);
+	}
+
+	free(pool->slabs);
+	pool->slabs = NULL;
+	pool->slabCount = 0;
+	pool->local = NULL;
+	pool->returned = NULL;
+}
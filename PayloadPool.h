@@ -0,0 +1,48 @@
+//==================================================//
+//			  BUFFER PAYLOAD POOL					//
+//==================================================//
+#ifndef PAYLOAD_POOL_H
+#define PAYLOAD_POOL_H
+
+#include <stddef.h>
+
+// Objects come from slabs of SLAB_SIZE bytes aligned to SLAB_SIZE, so the
+// slab (and the pool owning it) of any object is found from its address.
+// Every object starts on its own cache line.
+#define CACHE_LINE 64
+#define SLAB_SIZE (64 * 1024)
+
+typedef struct Payload_Object
+{
+	struct Payload_Object *next;
+} Payload_Object;
+
+// One pool per producer. Only the owning thread allocates, any thread frees:
+// freed objects are pushed on the lock-free return list and the owner takes
+// the whole list at once when its local free list runs dry.
+typedef struct Payload_Pool
+{
+	// Owner side.
+	size_t objectSize;		// Rounded up to whole cache lines.
+	Payload_Object *local;	// Recycled objects, owner only.
+	char *fresh;			// Next never used object of the newest slab.
+	char *freshEnd;
+	char **slabs;
+	int slabCount;
+	int slabCapacity;
+	long hits;				// Allocations served from recycled objects.
+	long misses;			// Allocations that had to take a new object.
+	size_t footprint;		// Bytes of slabs, slabs are kept until destroyed so this is the peak.
+
+	// Return side, written by the consumers, on its own cache line.
+	Payload_Object *returned __attribute__((aligned(CACHE_LINE)));
+} Payload_Pool;
+
+// Returns -1 when the list of slabs can not be allocated or an object does
+// not fit in a slab.
+int Payload_Pool_Init(Payload_Pool*, size_t);
+void* Payload_Alloc(Payload_Pool*);
+void Payload_Free(void*);
+void Payload_Pool_Destroy(Payload_Pool*);
+
+#endif